@@ -73,7 +73,18 @@ typedef struct
 
 #define REASSEMBLY_BUFFER_SIZE (64)
 
-Packet reassemblyBuffer[REASSEMBLY_BUFFER_SIZE];
+static Packet reassemblyBuffers[MERGE_MAX_INPUTS][REASSEMBLY_BUFFER_SIZE];
+Packet       *reassemblyBuffer = reassemblyBuffers[0];
+
+typedef struct
+{
+  enum RawFormats   format;
+  enum MultiPackets multiPackets;
+} InputDecoder;
+
+static InputDecoder inputDecoder[MERGE_MAX_INPUTS]; // State of the merged inputs that are not current
+static size_t       currentInput;
+static bool         showInputId;
 
 bool       showRaw       = false;
 bool       showData      = false;
@@ -84,6 +95,7 @@ bool       showJsonValue = false;
 bool       showVersion   = true;
 bool       showSI        = false; // Output everything in strict SI units
 GeoFormats showGeo       = GEO_DD;
+OutputMode outputMode    = OUTPUT_TEXT;
 
 char *sep = " ";
 char  closingBraces[16]; // } and ] chars to close sentence in JSON mode, otherwise empty string
@@ -98,8 +110,13 @@ int g_variableFieldIndex;
 
 static uint16_t currentDate = UINT16_MAX;
 static uint32_t currentTime = UINT32_MAX;
+static size_t   fieldValueStart; // Where the value of the last printed field starts in the output buffer
 
 static enum RawFormats detectFormat(const char *msg);
+static bool            parseLine(char *msg, RawMessage *m, int *result);
+static void            selectInput(size_t input);
+static bool            parseInputLine(size_t input, char *line, RawMessage *msg, int *r);
+static void            printReordered(size_t input, RawMessage *msg, uint8_t *data, size_t len);
 static void            printCanFormat(RawMessage *msg);
 static bool            printField(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits);
 static void            printCanRaw(RawMessage *msg);
@@ -109,8 +126,8 @@ static void usage(char **argv, char **av)
 {
   printf("Unknown or invalid argument %s\n", av[0]);
   printf("Usage: %s [[-raw] [-json [-empty] [-nv] [-camel | -upper-camel]] [-data] [-debug] [-d] [-q] [-si] [-geo {dd|dm|dms}] "
-         "-format <fmt> "
-         "[-src <src> | <pgn>]] ["
+         "-format <fmt> [-file <file>...] "
+         "[-decode-cache <n>] [-deadband <file>] [-resample <interval>] [-rate <n> [-rate-table <file>]] [-dedup <window>] [-reorder <window>] [-iso-tp] [-join <pgn>,<pgn>... [-join-window <t>]] [-filter <expr>] [-output <spec>] [-from <time>] [-to <time>] [-can <interface>] [-input-id] [-follow] [-cache-dir <dir>] [-split-dir <dir> [-split-src] [-split-csv]] [-src <src> | <pgn>]] ["
 #ifndef SKIP_SETSYSTEMCLOCK
          "-clocksrc <src> | "
 #endif
@@ -136,7 +153,48 @@ static void usage(char **argv, char **av)
     printf("%s, ", RAW_FORMAT_STR[i]);
   }
   printf("\n");
+  printf("     -decode-cache <n> Remember the decoded fields of the last <n> distinct messages and reuse them for\n"
+         "                       repeated identical payloads from the same source\n");
+  printf("     -deadband <file>  Only print PGNs listed in <file> when a field changed more than its deadband, or\n"
+         "                       when its interval passed. Each line is '<pgn> <field> <deadband> [<seconds>]'\n");
+  printf("     -resample <ivl>   Print each PGN, source and instance once per <ivl> (e.g. 500ms, 1s, 10s, 1m) with the\n"
+         "                       count, minimum, mean and maximum of its numeric fields\n");
+  printf("     -rate <n>         Pass at most <n> messages per second for each PGN and source\n");
+  printf("     -rate-table <f>   Override the rate per PGN with lines '<pgn> <n>' in file <f>; 0 means no limit\n");
+  printf("     -dedup <window>   Drop frames with the same PGN, source, destination and data as a frame less than\n"
+         "                       <window> (e.g. 50ms) apart, as logged by two gateways on the same bus\n");
+  printf("     -reorder <window> Reassemble fast packets whose frames are interleaved with those of the next fast\n"
+         "                       packet, holding complete ones for at most <window> (e.g. 20ms) to print them in order\n");
+  printf("     -iso-tp           Reassemble messages sent with the ISO 11783 transport protocol (PGN 60416 and 60160,\n"
+         "                       up to 1785 bytes) and decode them as the PGN they carry\n");
+  printf("     -join <pgns>      Print messages of the comma separated PGNs with the same source and SID as one record.\n"
+         "                       Can be given more than once\n");
+  printf("     -join-window <t>  Print a join that is not complete after <t> (default 1s) with the PGNs it has\n");
+  printf("     -filter <expr>    Only print PGNs that have a filter and match all of them. Can be given more than once.\n"
+         "                       <expr> is '<pgn>.<field> <op> <value>' with <op> one of < <= > >= = != or\n"
+         "                       '<pgn>.<field> between <low> and <high>' or '<pgn>.<field> in {<value>,...}'\n");
+  printf("     -output <spec>    Write to an output sink instead of stdout. Can be given more than once. <spec> is\n"
+         "                       '<mode>[,pgn=<pgn>[+<pgn>...]][,src=<src>]:<dest>' with <mode> one of text, json,\n"
+         "                       json-empty, json-nv, json-nv-empty or raw and <dest> a file, '-' or 'fd:<n>'\n");
+  printf("     -from <time>      Skip messages before <time>, e.g. 2023-01-01T14:03:00Z\n");
+  printf("     -to <time>        Stop at the first message after <time>\n"
+         "                       With -file, the <file>.idx index written by logindex is used to skip to the\n"
+         "                       blocks of the log that hold these times and the selected PGN and source.\n"
+         "                       Without an index a log in PLAIN or FAST format is searched for the -from time\n");
+  printf("     -file <file>      Read <file> instead of stdin. When given more than once the files are merged in\n"
+         "                       timestamp order, each with its own format detection\n");
+  printf("     -can <interface>  Read the frames from SocketCAN <interface>, e.g. can0, with kernel receive timestamps\n");
+  printf("     -input-id         Print the number of the -file that each message came from, starting at 1\n");
+  printf("     -follow           With -file, wait for more data at the end of the file, like 'tail -F'. The file is\n"
+         "                       read again when it is truncated and reopened when it is replaced by a new file\n");
+  printf("     -cache-dir <dir>  Store the output in <dir> and print it from there when the same input is analyzed\n"
+         "                       again with the same options\n");
+  printf("     -split-dir <dir>  Write every PGN to its own file <dir>/<pgn>.txt, .json or .csv instead of stdout\n");
+  printf("     -split-src        Write every PGN and source to its own file <dir>/<pgn>-<src>.<ext>\n");
+  printf("     -split-csv        Write the split files in CSV format with a header line\n");
   printf("     -version          Print the version of the program and quit\n");
+  printf("\nInput that is gzip or zstd compressed is decompressed when analyzer is built with 'make ZLIB=1' or\n"
+         "'make ZSTD=1'.\n");
   printf("\nThe following options are used to debug the analyzer:\n");
   printf("     -raw              Print raw bytes (obsolete, use -data)\n");
   printf("     -data             Print the PGN three times: in hex, ascii and analyzed\n");
@@ -150,11 +208,17 @@ int main(int argc, char **argv)
 {
   int    r;
   char   msg[2000];
-  FILE  *file = stdin;
-  int    ac   = argc;
-  char **av   = argv;
+  FILE  *file             = stdin;
+  char  *fileName         = NULL;
+  int    ac               = argc;
+  char **av               = argv;
+  char  *deadbandFile     = NULL;
+  char  *resampleInterval = NULL;
+  bool   compressed;
+  bool   complete = true;
 
   setProgName(argv[0]);
+  checkPgnList(); // Also builds the PGN index that the options below use
 
   for (; ac > 1; ac--, av++)
   {
@@ -271,6 +335,127 @@ int main(int argc, char **argv)
       {
         logAbort("Cannot open file %s\n", av[2]);
       }
+      fileName = av[2];
+      mergeAddFile(file, av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-can") == 0)
+    {
+      canSetInterface(av[2]);
+      ac--;
+      av++;
+    }
+    else if (strcasecmp(av[1], "-input-id") == 0)
+    {
+      showInputId = true;
+    }
+    else if (strcasecmp(av[1], "-follow") == 0)
+    {
+      followSetEnabled();
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-cache-dir") == 0)
+    {
+      diskCacheSetDir(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-decode-cache") == 0)
+    {
+      decodeCacheInit(strtoul(av[2], 0, 10));
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-deadband") == 0)
+    {
+      deadbandFile = av[2];
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-rate") == 0)
+    {
+      rateLimitInit(strtod(av[2], 0));
+      ac--;
+      av++;
+    }
+    else if (strcasecmp(av[1], "-iso-tp") == 0)
+    {
+      tpInit();
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-reorder") == 0)
+    {
+      reorderInit(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-dedup") == 0)
+    {
+      dedupInit(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-rate-table") == 0)
+    {
+      rateLimitLoad(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-filter") == 0)
+    {
+      filterAdd(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-output") == 0)
+    {
+      sinkAdd(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-from") == 0)
+    {
+      rangeSetFrom(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-to") == 0)
+    {
+      rangeSetTo(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-split-dir") == 0)
+    {
+      splitSetDir(av[2]);
+      ac--;
+      av++;
+    }
+    else if (strcasecmp(av[1], "-split-src") == 0)
+    {
+      splitSetBySrc();
+    }
+    else if (strcasecmp(av[1], "-split-csv") == 0)
+    {
+      splitSetCsv();
+      showJson      = true;
+      showJsonEmpty = false;
+      showJsonValue = false;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-join") == 0)
+    {
+      joinAddGroup(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-join-window") == 0)
+    {
+      joinSetWindow(av[2]);
+      ac--;
+      av++;
+    }
+    else if (ac > 2 && strcasecmp(av[1], "-resample") == 0)
+    {
+      resampleInterval = av[2];
       ac--;
       av++;
     }
@@ -314,7 +499,7 @@ int main(int argc, char **argv)
   {
     logInfo("N2K packet analyzer\n" COPYRIGHT);
   }
-  else if (showVersion)
+  else if (showVersion && !sinksEnabled() && !splitEnabled())
   {
     printf("{\"version\":\"%s\",\"units\":\"%s\",\"showLookupValues\":%s}\n",
            VERSION,
@@ -322,107 +507,292 @@ int main(int argc, char **argv)
            showJsonValue ? "true" : "false");
   }
 
+  outputMode = getOutputMode();
+
+  if (sinksEnabled() && (resampleInterval != NULL || joinEnabled()))
+  {
+    logAbort("-output cannot be combined with -resample or -join\n");
+  }
+  if (deadbandFile != NULL && resampleInterval != NULL)
+  {
+    logAbort("-deadband cannot be combined with -resample\n");
+  }
+  if (splitEnabled() && (sinksEnabled() || resampleInterval != NULL || joinEnabled()))
+  {
+    logAbort("-split-dir cannot be combined with -output, -resample or -join\n");
+  }
+  if (diskCacheEnabled()
+      && (sinksEnabled() || splitEnabled() || resampleInterval != NULL || joinEnabled() || deadbandFile != NULL
+          || rateLimitEnabled() || dedupEnabled() || reorderEnabled() || tpEnabled() || showRaw || showData || clockSrc >= 0))
+  {
+    logAbort("-cache-dir cannot be combined with -output, -split-dir, -resample, -join, -deadband, -rate, -dedup, -reorder, "
+             "-iso-tp, -raw, -data or -clocksrc\n");
+  }
+  if (mergeEnabled() && (followEnabled() || diskCacheEnabled()))
+  {
+    logAbort("Several -file options cannot be combined with -follow or -cache-dir\n");
+  }
+  if (canEnabled() && (fileName != NULL || followEnabled() || diskCacheEnabled()))
+  {
+    logAbort("-can cannot be combined with -file, -follow or -cache-dir\n");
+  }
+  diskCacheSetOptions(argc, argv);
+  diskCacheState(reassemblyBuffers[0], sizeof(reassemblyBuffers[0]));
+  diskCacheState(&format, sizeof(format));
+  diskCacheState(&multiPackets, sizeof(multiPackets));
+
   fillLookups();
   fillFieldType(true);
-  checkPgnList();
+  fillBitLookups(sinkMainMode(outputMode));
+  filterInit();
+  if (deadbandFile != NULL)
+  {
+    deadbandLoad(deadbandFile);
+  }
+  if (resampleInterval != NULL)
+  {
+    resampleInit(resampleInterval);
+  }
+  sinkOpen();
+  splitInit();
+  reorderSetPrinter(printReordered);
+  if (canEnabled())
+  {
+    format       = RAWFORMAT_PLAIN;
+    multiPackets = MULTIPACKETS_SEPARATE;
+    canOpen();
+  }
+  else if (mergeEnabled())
+  {
+    for (size_t i = 0; i < MERGE_MAX_INPUTS; i++)
+    {
+      inputDecoder[i].format       = format;
+      inputDecoder[i].multiPackets = multiPackets;
+    }
+    mergeSetParser(parseInputLine);
+  }
+  else
+  {
+    followOpen(fileName);
+    compressed = inputOpen(file);
+    if (compressed && followEnabled())
+    {
+      logAbort("-follow cannot be used with compressed input\n");
+    }
+    rangeOpen(file,
+              compressed ? NULL : fileName,
+              onlyPgn,
+              onlySrc,
+              !compressed
+                  && (format == RAWFORMAT_UNKNOWN || format == RAWFORMAT_PLAIN || format == RAWFORMAT_FAST
+                      || format == RAWFORMAT_PLAIN_OR_FAST));
+    diskCacheOpen();
+  }
 
-  while (fgets(msg, sizeof(msg) - 1, file))
+  for (;;)
   {
-    RawMessage m;
+    RawMessage  parsed;
+    RawMessage *m    = &parsed;
+    char       *line = msg;
 
-    if (*msg == 0 || *msg == '\r' || *msg == '\n' || *msg == '#')
+    if (canEnabled())
     {
-      if (*msg == '#')
+      // The text of the frame is only needed for the raw output sinks
+      msg[0] = '\0';
+      if (!canNext(m, sinksEnabled() ? msg : NULL, sizeof(msg)))
       {
-        if (strncmp(msg + 1, "SHOWBUFFERS", STRSIZE("SHOWBUFFERS")) == 0)
-        {
-          showBuffers();
-        }
+        break;
       }
-
-      continue;
+      r = 0;
     }
+    else if (mergeEnabled())
+    {
+      size_t input;
 
-    if (format == RAWFORMAT_UNKNOWN)
+      if (!mergeNext(&input, &line, &m, &r))
+      {
+        break;
+      }
+      selectInput(input);
+    }
+    else
     {
-      format = detectFormat(msg);
-      if (format == RAWFORMAT_GARMIN_CSV1 || format == RAWFORMAT_GARMIN_CSV2)
+      if (!diskCacheReadLine(msg, sizeof(msg) - 1, file))
+      {
+        break;
+      }
+      if (!parseLine(msg, m, &r))
       {
-        // Skip first line containing header line
         continue;
       }
     }
 
-    switch (format)
+    if (r == 0)
     {
-      case RAWFORMAT_PLAIN_OR_FAST:
-        multiPackets = MULTIPACKETS_SEPARATE;
-        r            = parseRawFormatPlain(msg, &m, showJson);
-        logDebug("plain_or_fast: plain r=%d\n", r);
-        if (r < 0)
-        {
-          multiPackets = MULTIPACKETS_COALESCED;
-          r            = parseRawFormatFast(msg, &m, showJson);
-          logDebug("plain_or_fast: fast r=%d\n", r);
-        }
+      int c = rangeCheck(m);
+
+      if (c < 0)
+      {
+        continue;
+      }
+      if (c > 0)
+      {
+        complete = false;
         break;
+      }
+      sinkRaw(line, m);
+      printCanFormat(m);
+      printCanRaw(m);
+    }
+    else
+    {
+      logError("Unknown message error %d: '%s'\n", r, line);
+    }
+  }
 
-      case RAWFORMAT_PLAIN:
-        r = parseRawFormatPlain(msg, &m, showJson);
-        if (r >= 0)
-        {
-          break;
-        }
-        // Else fall through to fast!
+  reorderFlush();
+  resampleFlush();
+  joinFlush();
+  diskCacheClose(complete);
+  inputClose();
+  mergeClose();
+  sinkClose();
+  splitClose();
+  dedupStatistics();
+  reorderStatistics();
+  tpStatistics();
+  rateLimitStatistics();
+  decodeCacheStatistics();
+  return 0;
+}
 
-      case RAWFORMAT_FAST:
-        r = parseRawFormatFast(msg, &m, showJson);
-        if (r >= 0 && format == RAWFORMAT_PLAIN)
-        {
-          logInfo("Detected normal format with all frames on one line\n");
-          multiPackets = MULTIPACKETS_COALESCED;
-          format       = RAWFORMAT_FAST;
-        }
-        break;
+/*
+ * Parse a line of the log in the format of the current input, detecting the format on its
+ * first line. Returns false when the line does not hold a message.
+ */
+static bool parseLine(char *msg, RawMessage *m, int *result)
+{
+  int r;
 
-      case RAWFORMAT_AIRMAR:
-        r = parseRawFormatAirmar(msg, &m, showJson);
-        break;
+  if (*msg == 0 || *msg == '\r' || *msg == '\n' || *msg == '#')
+  {
+    if (*msg == '#')
+    {
+      if (strncmp(msg + 1, "SHOWBUFFERS", STRSIZE("SHOWBUFFERS")) == 0)
+      {
+        showBuffers();
+      }
+    }
 
-      case RAWFORMAT_CHETCO:
-        r = parseRawFormatChetco(msg, &m, showJson);
-        break;
+    return false;
+  }
 
-      case RAWFORMAT_GARMIN_CSV1:
-      case RAWFORMAT_GARMIN_CSV2:
-        r = parseRawFormatGarminCSV(msg, &m, showJson, format == RAWFORMAT_GARMIN_CSV2);
-        break;
+  if (format == RAWFORMAT_UNKNOWN)
+  {
+    format = detectFormat(msg);
+    if (format == RAWFORMAT_GARMIN_CSV1 || format == RAWFORMAT_GARMIN_CSV2)
+    {
+      // Skip first line containing header line
+      return false;
+    }
+  }
 
-      case RAWFORMAT_YDWG02:
-        r = parseRawFormatYDWG02(msg, &m, showJson);
-        break;
+  switch (format)
+  {
+    case RAWFORMAT_PLAIN_OR_FAST:
+      multiPackets = MULTIPACKETS_SEPARATE;
+      r            = parseRawFormatPlain(msg, m, showJson);
+      logDebug("plain_or_fast: plain r=%d\n", r);
+      if (r < 0)
+      {
+        multiPackets = MULTIPACKETS_COALESCED;
+        r            = parseRawFormatFast(msg, m, showJson);
+        logDebug("plain_or_fast: fast r=%d\n", r);
+      }
+      break;
 
-      case RAWFORMAT_ACTISENSE_N2K_ASCII:
-        r = parseRawFormatActisenseN2KAscii(msg, &m, showJson);
+    case RAWFORMAT_PLAIN:
+      r = parseRawFormatPlain(msg, m, showJson);
+      if (r >= 0)
+      {
         break;
+      }
+      // Else fall through to fast!
 
-      default:
-        logError("Unknown message format\n");
-        exit(1);
-    }
+    case RAWFORMAT_FAST:
+      r = parseRawFormatFast(msg, m, showJson);
+      if (r >= 0 && format == RAWFORMAT_PLAIN)
+      {
+        logInfo("Detected normal format with all frames on one line\n");
+        multiPackets = MULTIPACKETS_COALESCED;
+        format       = RAWFORMAT_FAST;
+      }
+      break;
 
-    if (r == 0)
-    {
-      printCanFormat(&m);
-      printCanRaw(&m);
-    }
-    else
-    {
-      logError("Unknown message error %d: '%s'\n", r, msg);
-    }
+    case RAWFORMAT_AIRMAR:
+      r = parseRawFormatAirmar(msg, m, showJson);
+      break;
+
+    case RAWFORMAT_CHETCO:
+      r = parseRawFormatChetco(msg, m, showJson);
+      break;
+
+    case RAWFORMAT_GARMIN_CSV1:
+    case RAWFORMAT_GARMIN_CSV2:
+      r = parseRawFormatGarminCSV(msg, m, showJson, format == RAWFORMAT_GARMIN_CSV2);
+      break;
+
+    case RAWFORMAT_YDWG02:
+      r = parseRawFormatYDWG02(msg, m, showJson);
+      break;
+
+    case RAWFORMAT_ACTISENSE_N2K_ASCII:
+      if (diskCacheEnabled())
+      {
+        logAbort("-cache-dir cannot be used for ACTISENSE_N2K_ASCII input, as its dates are taken from the clock\n");
+      }
+      r = parseRawFormatActisenseN2KAscii(msg, m, showJson);
+      break;
+
+    default:
+      logError("Unknown message format\n");
+      exit(1);
   }
 
-  return 0;
+  *result = r;
+  return true;
+}
+
+/*
+ * Switch to the detected format and fast packet reassembly state of a merged input.
+ */
+static void selectInput(size_t input)
+{
+  if (input == currentInput)
+  {
+    return;
+  }
+  inputDecoder[currentInput].format       = format;
+  inputDecoder[currentInput].multiPackets = multiPackets;
+  currentInput                            = input;
+  format                                  = inputDecoder[input].format;
+  multiPackets                            = inputDecoder[input].multiPackets;
+  reassemblyBuffer                        = reassemblyBuffers[input];
+}
+
+static bool parseInputLine(size_t input, char *line, RawMessage *msg, int *r)
+{
+  selectInput(input);
+  return parseLine(line, msg, r);
+}
+
+static void printReordered(size_t input, RawMessage *msg, uint8_t *data, size_t len)
+{
+  size_t current = currentInput;
+
+  selectInput(input);
+  printPgn(msg, data, len, showData, showJson);
+  selectInput(current);
 }
 
 static enum RawFormats detectFormat(const char *msg)
@@ -640,17 +1010,24 @@ static void showBuffers(void)
   }
 }
 
+/*
+ * Is the message selected by the PGN and source given on the command line?
+ */
+static bool selected(const RawMessage *msg)
+{
+  return (onlySrc < 0 || onlySrc == msg->src) && (onlyPgn <= 0 || onlyPgn == msg->pgn);
+}
+
 static void printCanFormat(RawMessage *msg)
 {
   Pgn    *pgn;
   size_t  buffer;
   Packet *p;
+  bool    fastPacket;
+  bool    transport = tpEnabled() && (msg->pgn == ISO_TP_CM_PGN || msg->pgn == ISO_TP_DT_PGN);
 
-  if (onlySrc >= 0 && onlySrc != msg->src)
-  {
-    return;
-  }
-  if (onlyPgn > 0 && onlyPgn != msg->pgn)
+  // Transport protocol frames are selected on the message that they carry
+  if (!transport && !selected(msg))
   {
     return;
   }
@@ -660,12 +1037,42 @@ static void printCanFormat(RawMessage *msg)
   {
     pgn = searchForUnknownPgn(msg->pgn);
   }
-  if (multiPackets == MULTIPACKETS_COALESCED || !pgn || pgn->type != PACKET_FAST)
+  fastPacket = multiPackets != MULTIPACKETS_COALESCED && pgn != NULL && pgn->type == PACKET_FAST;
+  if (dedupDrop(msg, currentInput))
+  {
+    return;
+  }
+  if (transport)
+  {
+    uint8_t    *tpData;
+    size_t      tpLen;
+    RawMessage *tpMsg = tpFrame(msg, currentInput, &tpData, &tpLen);
+
+    // The rate limit applies to the reassembled message, not to the frames that carry it
+    if (tpMsg != NULL && selected(tpMsg) && !rateLimitDrop(tpMsg, false))
+    {
+      printPgn(tpMsg, tpData, tpLen, showData, showJson);
+    }
+    if (msg->pgn == ISO_TP_DT_PGN || !selected(msg))
+    {
+      return;
+    }
+  }
+  if (rateLimitDrop(msg, fastPacket))
+  {
+    return;
+  }
+  if (!fastPacket)
   {
     // No reassembly needed
     printPgn(msg, msg->data, msg->len, showData, showJson);
     return;
   }
+  if (reorderEnabled())
+  {
+    reorderFrame(msg, currentInput);
+    return;
+  }
 
   // Fast packet requires re-asssembly
   // We only get here if we know for sure that the PGN is fast-packet
@@ -893,6 +1300,13 @@ static bool printField(Field *field, char *fieldName, uint8_t *data, size_t data
     }
   }
 
+  // JSON leaves out fields that are 'not available', so skip those without extracting the value
+  if ((outputMode == OUTPUT_JSON || outputMode == OUTPUT_JSON_NV) && fieldNotAvailable(field, data, startBit, *bits))
+  {
+    logDebug("PGN %u: printField <%s> is not available\n", field->pgn->pgn, field->name);
+    return true;
+  }
+
   if (field->ft != NULL && field->ft->pf != NULL)
   {
     size_t location            = mlocation();
@@ -918,11 +1332,12 @@ static bool printField(Field *field, char *fieldName, uint8_t *data, size_t data
         sep = ";";
       }
     }
-    location3 = mlocation();
+    location3       = mlocation();
+    fieldValueStart = location3;
     logDebug(
         "PGN %u: printField <%s>, \"%s\": calling function for %s\n", field->pgn->pgn, field->name, fieldName, field->fieldType);
     g_skip = false;
-    r      = (field->ft->pf)(field, fieldName, data, dataLen, startBit, bits);
+    r      = (field->ft->pfMode[outputMode])(field, fieldName, data, dataLen, startBit, bits);
     // if match fails, r == false. If field is not printed, g_skip == true
     logDebug("PGN %u: printField <%s>, \"%s\": result %d bits=%zu\n", field->pgn->pgn, field->name, fieldName, r, *bits);
     if (r && !g_skip)
@@ -967,81 +1382,72 @@ static bool printField(Field *field, char *fieldName, uint8_t *data, size_t data
   return false;
 }
 
-bool printPgn(RawMessage *msg, uint8_t *data, int length, bool showData, bool showJson)
+/*
+ * Return the name of a field in a repeating set with the repetition number appended,
+ * as used in text output. The names are built once per field and repetition.
+ */
+static char *getRepetitionName(Field *field, int repetition)
 {
-  Pgn *pgn;
+  static char fieldName[60];
+  const char *name = field->camelName ? field->camelName : field->name;
+  const char *sfx  = field->camelName ? "_" : " ";
 
-  size_t  i;
-  size_t  bits;
-  size_t  startBit;
-  int     repetition;
-  char    fieldName[60];
-  bool    r;
-  size_t  variableFields; // How many variable fields remain (product of repetition count * # of fields)
-  uint8_t variableFieldStart;
-  uint8_t variableFieldCount;
-
-  if (msg == NULL)
+  if (repetition > UINT8_MAX)
   {
-    return false;
-  }
-  pgn = getMatchingPgn(msg->pgn, data, length);
-  if (!pgn)
-  {
-    logAbort("No PGN definition found for PGN %u\n", msg->pgn);
+    snprintf(fieldName, sizeof(fieldName), "%s%s%d", name, sfx, repetition);
+    return fieldName;
   }
-
-  if (showData)
+  if (field->repetitionName == NULL)
   {
-    FILE *f = stdout;
-
-    if (showJson)
+    field->repetitionName = calloc(UINT8_MAX + 1, sizeof(char *));
+    if (field->repetitionName == NULL)
     {
-      f = stderr;
+      die("Out of memory");
     }
-
-    fprintf(f, "%s %u %3u %3u %6u %s: ", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
-    for (i = 0; i < length; i++)
-    {
-      fprintf(f, " %2.02X", data[i]);
-    }
-    putc('\n', f);
-
-    fprintf(f, "%s %u %3u %3u %6u %s: ", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
-    for (i = 0; i < length; i++)
-    {
-      fprintf(f, "  %c", isalnum(data[i]) ? data[i] : '.');
-    }
-    putc('\n', f);
   }
-  if (showJson)
+  if (field->repetitionName[repetition] == NULL)
   {
-    if (pgn->camelDescription)
+    snprintf(fieldName, sizeof(fieldName), "%s%s%d", name, sfx, repetition);
+    field->repetitionName[repetition] = strdup(fieldName);
+    if (field->repetitionName[repetition] == NULL)
     {
-      mprintf("\"%s\":", pgn->camelDescription);
+      die("Out of memory");
     }
-    mprintf("{\"timestamp\":\"%s\",\"prio\":%u,\"src\":%u,\"dst\":%u,\"pgn\":%u,\"description\":\"%s\"",
-            msg->timestamp,
-            msg->prio,
-            msg->src,
-            msg->dst,
-            msg->pgn,
-            pgn->description);
-    strcpy(closingBraces, "}");
-    sep = ",\"fields\":{";
-  }
-  else
-  {
-    mprintf("%s %u %3u %3u %6u %s:", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
-    sep = " ";
   }
+  return field->repetitionName[repetition];
+}
+
+/*
+ * Print the field section of a PGN, e.g. everything that follows the header with the
+ * timestamp, prio, src, dst and pgn, including the closing braces and newline.
+ * On return `missingFields` contains the number of fields that were expected in the
+ * repeating set but not present in the data.
+ */
+static bool printPgnFields(RawMessage *msg, Pgn *pgn, uint8_t *data, int length, size_t *missingFields)
+{
+  size_t  i;
+  size_t  bits;
+  size_t  startBit;
+  int     repetition;
+  char   *fieldName;
+  bool    r;
+  size_t  variableFields; // How many variable fields remain (product of repetition count * # of fields)
+  uint8_t variableFieldStart;
+  uint8_t variableFieldCount;
+  bool    csv = splitCsvEnabled();
+  size_t  location;
 
   logDebug("fieldCount=%d repeatingStart1=%" PRIu8 "\n", pgn->fieldCount, pgn->repeatingStart1);
 
+  setAllOnesMask(data, length);
+  splitRecordStart();
+
   g_variableFieldRepeat[0] = 255; // Can be overridden by '# of parameters'
   g_variableFieldRepeat[1] = 0;   // Can be overridden by '# of parameters'
   repetition               = 0;
   variableFields           = 0;
+  variableFieldStart       = 0;
+  variableFieldCount       = 0;
   r                        = true;
   for (i = 0, startBit = 0; (startBit >> 3) < length; i++)
   {
@@ -1109,18 +1515,25 @@ bool printPgn(RawMessage *msg, uint8_t *data, int length, bool showData, bool sh
       break;
     }
 
-    strcpy(fieldName, field->camelName ? field->camelName : field->name);
     if (repetition >= 1 && !showJson)
     {
-      strcat(fieldName, field->camelName ? "_" : " ");
-      sprintf(fieldName + strlen(fieldName), "%u", repetition);
+      fieldName = getRepetitionName(field, repetition);
+    }
+    else
+    {
+      fieldName = field->camelName ? field->camelName : (char *) field->name;
     }
 
+    location = mlocation();
     if (!printField(field, fieldName, data, length, startBit, &bits))
     {
       r = false;
       break;
     }
+    if (csv && mlocation() > location)
+    {
+      splitColumn(i, fieldValueStart, mlocation());
+    }
 
     startBit += bits;
   }
@@ -1134,23 +1547,162 @@ bool printPgn(RawMessage *msg, uint8_t *data, int length, bool showData, bool sh
   }
   mprintf("\n");
 
+  *missingFields = (g_variableFieldRepeat[0] < UINT8_MAX) ? variableFields : 0;
+  return r;
+}
+
+/*
+ * Format the message in the current output mode and write it.
+ */
+static bool printPgnRecord(RawMessage *msg, Pgn *pgn, uint8_t *data, int length)
+{
+  size_t         headerEnd;
+  size_t         missingFields = 0;
+  bool           r;
+  bool           useCache;
+  const char    *cached        = NULL;
+  size_t         cachedLen;
+  DecodeCacheKey cacheKey;
+
+  if (showJson)
+  {
+    if (pgn->camelDescription)
+    {
+      mprintf("\"%s\":", pgn->camelDescription);
+    }
+    mprintf("{\"timestamp\":\"%s\",\"prio\":%u,\"src\":%u,\"dst\":%u,\"pgn\":%u,\"description\":\"%s\"",
+            msg->timestamp,
+            msg->prio,
+            msg->src,
+            msg->dst,
+            msg->pgn,
+            pgn->description);
+    if (showInputId)
+    {
+      mprintf(",\"input\":%zu", currentInput + 1);
+    }
+    strcpy(closingBraces, "}");
+    sep = ",\"fields\":{";
+  }
+  else
+  {
+    mprintf("%s %u %3u %3u %6u %s", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
+    if (showInputId)
+    {
+      mprintf(" (input %zu)", currentInput + 1);
+    }
+    mprintf(":");
+    sep = " ";
+  }
+  headerEnd = mlocation();
+
+  useCache = decodeCacheEnabled() && !splitCsvEnabled();
+  if (useCache)
+  {
+    decodeCacheKey(&cacheKey, outputMode, msg->pgn, msg->src, data, length);
+    cached = decodeCacheLookup(&cacheKey, &cachedLen);
+  }
+
+  if (cached != NULL)
+  {
+    mappend(cached, cachedLen);
+    r = true;
+  }
+  else
+  {
+    r = printPgnFields(msg, pgn, data, length, &missingFields);
+    if (r && missingFields == 0 && useCache)
+    {
+      decodeCacheStore(&cacheKey, mpointer(headerEnd), mlocation() - headerEnd);
+    }
+  }
+
   if (r)
   {
-    mwrite(stdout);
-    if (variableFields > 0 && g_variableFieldRepeat[0] < UINT8_MAX)
+    resampleAppend();
+    if (!joinCapture() && !splitWrite(pgn, msg))
+    {
+      sinkWrite();
+    }
+    if (missingFields > 0)
     {
-      logError("PGN %u has %zu missing fields in repeating set\n", msg->pgn, variableFields);
+      logError("PGN %u has %zu missing fields in repeating set\n", msg->pgn, missingFields);
     }
   }
   else
   {
     if (!showJson)
     {
-      mwrite(stdout);
+      sinkWrite();
     }
     mreset();
+    joinDiscard();
     logError("PGN %u analysis error\n", msg->pgn);
   }
+  return r;
+}
+
+bool printPgn(RawMessage *msg, uint8_t *data, int length, bool showData, bool showJson)
+{
+  Pgn   *pgn;
+  size_t i;
+  bool   r;
+
+  if (msg == NULL)
+  {
+    return false;
+  }
+  pgn = getMatchingPgn(msg->pgn, data, length);
+  if (!pgn)
+  {
+    logAbort("No PGN definition found for PGN %u\n", msg->pgn);
+  }
+  // A resampled message is printed when its bucket ends; it passed the filter when it was collected
+  if (!resampleFlushing()
+      && (!filterPass(pgn, data, length) || deadbandSuppress(pgn, msg, data, length) || resampleCollect(pgn, msg, data, length)))
+  {
+    return true;
+  }
+  joinCollect(pgn, msg, data, length);
+
+  if (showData)
+  {
+    FILE *f = stdout;
+
+    if (showJson)
+    {
+      f = stderr;
+    }
+
+    fprintf(f, "%s %u %3u %3u %6u %s: ", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
+    for (i = 0; i < length; i++)
+    {
+      fprintf(f, " %2.02X", data[i]);
+    }
+    putc('\n', f);
+
+    fprintf(f, "%s %u %3u %3u %6u %s: ", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn, pgn->description);
+    for (i = 0; i < length; i++)
+    {
+      fprintf(f, "  %c", isalnum(data[i]) ? data[i] : '.');
+    }
+    putc('\n', f);
+  }
+
+  if (sinksEnabled())
+  {
+    r = true;
+    for (i = 0; sinkSelect(&i, msg);)
+    {
+      r = printPgnRecord(msg, pgn, data, length) && r;
+      setLogQuiet(true); // Log what is wrong with the message for the first sink only
+    }
+    setLogQuiet(false);
+  }
+  else
+  {
+    r = printPgnRecord(msg, pgn, data, length);
+  }
 
   if (msg->pgn == 126992 && currentDate < UINT16_MAX && currentTime < UINT32_MAX && clockSrc == msg->src)
   {
@@ -60,6 +60,12 @@ limitations under the License.
 #define max(x, y) ((x) >= (y) ? (x) : (y))
 #endif
 
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
 #include "pgn.h"
 
 #define DST_GLOBAL (0xff) /* The address used when a message is addressed to -all- stations */
@@ -85,12 +91,14 @@ extern bool       showData;
 extern bool       showJson;
 extern bool       showJsonEmpty;
 extern bool       showJsonValue;
+extern bool       showVersion;
 extern bool       showBytes;
 extern bool       showSI;
 extern GeoFormats showGeo;
 extern char      *sep;
 extern char       closingBraces[16]; // } and ] chars to close sentence in JSON mode, otherwise empty string
 extern bool       g_skip;
+extern OutputMode outputMode; // Selected once at startup from the show* flags
 
 /* analyzer.c */
 
@@ -106,3 +114,177 @@ extern char   mchr(size_t location);
 extern void   minsert(size_t location, const char *str);
 extern void   printEmpty(const char *name, int64_t exceptionValue);
 extern bool   adjustDataLenStart(uint8_t **data, size_t *dataLen, size_t *startBit);
+
+extern void        mappend(const char *data, size_t len);
+extern const char *mpointer(size_t location);
+
+extern OutputMode             getOutputMode(void);
+extern FieldPrintFunctionType getFieldPrinter(FieldPrintFunctionType pf, OutputMode mode);
+extern void                   fillBitLookups(OutputMode mode);
+extern void                   setAllOnesMask(const uint8_t *data, size_t len);
+extern bool                   fieldNotAvailable(const Field *field, const uint8_t *data, size_t startBit, size_t bits);
+
+/* cache.c */
+
+typedef struct DecodeCacheKey
+{
+  uint64_t       hash;
+  OutputMode     mode;
+  uint32_t       pgn;
+  uint8_t        src;
+  const uint8_t *data;
+  size_t         dataLen;
+} DecodeCacheKey;
+
+extern void        decodeCacheInit(size_t entries);
+extern bool        decodeCacheEnabled(void);
+extern void decodeCacheKey(DecodeCacheKey *key, OutputMode mode, uint32_t pgn, uint8_t src, const uint8_t *data, size_t dataLen);
+extern const char *decodeCacheLookup(const DecodeCacheKey *key, size_t *textLen);
+extern void        decodeCacheStore(const DecodeCacheKey *key, const char *text, size_t textLen);
+extern void        decodeCacheStatistics(void);
+
+/* deadband.c */
+
+extern void deadbandLoad(const char *filename);
+extern bool deadbandSuppress(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length);
+
+/* resample.c */
+
+extern void resampleInit(const char *interval);
+extern bool resampleCollect(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length);
+extern void resampleAppend(void);
+extern void resampleFlush(void);
+extern bool resampleFlushing(void);
+
+/* rate.c */
+
+extern void rateLimitInit(double rate);
+extern void rateLimitLoad(const char *filename);
+extern bool rateLimitEnabled(void);
+extern bool rateLimitDrop(const RawMessage *msg, bool fastPacket);
+extern void rateLimitStatistics(void);
+
+/* reorder.c */
+
+typedef void (*ReorderPrinter)(size_t input, RawMessage *msg, uint8_t *data, size_t len);
+
+extern void reorderInit(const char *window);
+extern bool reorderEnabled(void);
+extern void reorderSetPrinter(ReorderPrinter p);
+extern void reorderFrame(const RawMessage *msg, size_t input);
+extern void reorderFlush(void);
+extern void reorderStatistics(void);
+
+/* tp.c */
+
+#define ISO_TP_DT_PGN (60160)
+#define ISO_TP_CM_PGN (60416)
+
+extern void        tpInit(void);
+extern bool        tpEnabled(void);
+extern RawMessage *tpFrame(const RawMessage *msg, size_t input, uint8_t **data, size_t *len);
+extern void        tpStatistics(void);
+
+/* dedup.c */
+
+extern void dedupInit(const char *window);
+extern bool dedupEnabled(void);
+extern bool dedupDrop(const RawMessage *msg, size_t input);
+extern void dedupStatistics(void);
+
+/* join.c */
+
+extern void joinAddGroup(const char *pgns);
+extern void joinSetWindow(const char *window);
+extern bool joinEnabled(void);
+extern void joinCollect(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length);
+extern bool joinCapture(void);
+extern void joinDiscard(void);
+extern void joinFlush(void);
+
+/* filter.c */
+
+extern void filterAdd(const char *expression);
+extern void filterInit(void);
+extern bool filterPass(const Pgn *pgn, uint8_t *data, size_t length);
+
+/* sink.c */
+
+extern void       sinkAdd(const char *spec);
+extern bool       sinksEnabled(void);
+extern OutputMode sinkMainMode(OutputMode mode);
+extern void       sinkOpen(void);
+extern void       sinkClose(void);
+extern void       sinkRaw(const char *line, const RawMessage *msg);
+extern bool       sinkSelect(size_t *index, const RawMessage *msg);
+extern void       sinkWrite(void);
+
+/* split.c */
+
+extern void splitSetDir(const char *dir);
+extern void splitSetBySrc(void);
+extern void splitSetCsv(void);
+extern bool splitEnabled(void);
+extern bool splitCsvEnabled(void);
+extern void splitInit(void);
+extern void splitRecordStart(void);
+extern void splitColumn(size_t index, size_t start, size_t end);
+extern bool splitWrite(const Pgn *pgn, const RawMessage *msg);
+extern void splitClose(void);
+
+/* diskcache.c */
+
+extern void  diskCacheSetDir(const char *dir);
+extern bool  diskCacheEnabled(void);
+extern void  diskCacheSetOptions(int argc, char **argv);
+extern void  diskCacheState(void *data, size_t len);
+extern void  diskCacheOpen(void);
+extern char *diskCacheReadLine(char *line, int size, FILE *file);
+extern void  diskCacheCapture(const char *data, size_t len);
+extern void  diskCacheClose(bool complete);
+
+/* can.c */
+
+extern void canSetInterface(const char *name);
+extern bool canEnabled(void);
+extern void canOpen(void);
+extern bool canNext(RawMessage *msg, char *line, size_t size);
+
+/* merge.c */
+
+#define MERGE_MAX_INPUTS (16)
+#define MERGE_LINE_SIZE (2000)
+
+typedef bool (*MergeParser)(size_t input, char *line, RawMessage *msg, int *r);
+
+extern void mergeAddFile(FILE *file, const char *name);
+extern bool mergeEnabled(void);
+extern void mergeSetParser(MergeParser parser);
+extern bool mergeNext(size_t *input, char **line, RawMessage **msg, int *r);
+extern void mergeClose(void);
+
+/* follow.c */
+
+extern void  followSetEnabled(void);
+extern bool  followEnabled(void);
+extern void  followOpen(const char *name);
+extern char *followReadLine(char *line, int size, FILE *file);
+
+/* input.c */
+
+typedef struct InputReader InputReader;
+
+extern InputReader *inputReaderOpen(FILE *file);
+extern char        *inputReaderReadLine(InputReader *in, char *line, int size);
+extern void         inputReaderClose(InputReader *in);
+extern bool         inputOpen(FILE *file);
+extern char        *inputReadLine(char *line, int size, FILE *file);
+extern void         inputClose(void);
+
+/* range.c */
+
+extern void  rangeSetFrom(const char *from);
+extern void  rangeSetTo(const char *to);
+extern void  rangeOpen(FILE *file, const char *name, int onlyPgn, int onlySrc, bool timeOrdered);
+extern char *rangeReadLine(char *line, int size, FILE *file);
+extern int   rangeCheck(const RawMessage *msg);
@@ -0,0 +1,246 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Decode cache.
+ *
+ * Many PGNs are sent over and over again with exactly the same payload: address claims,
+ * product information, switch bank status, heartbeats, ... The decode cache remembers
+ * the formatted field section (everything after the header with timestamp, prio, src,
+ * dst and pgn) of the last `decodeCacheSize` distinct messages, keyed by PGN, source and
+ * payload. When the same message is seen again only the header is formatted and the
+ * fields are copied from the cache.
+ *
+ * The memory used is bounded by the number of entries; when all entries are in use the
+ * least recently used entry is evicted.
+ */
+
+#include "analyzer.h"
+
+typedef struct CacheEntry
+{
+  uint64_t           hash;
+  OutputMode         mode;
+  uint32_t           pgn;
+  uint8_t            src;
+  size_t             dataLen;
+  uint8_t            data[FASTPACKET_MAX_SIZE];
+  char              *text;
+  size_t             textLen;
+  size_t             textAlloc;
+  struct CacheEntry *hashNext;
+  struct CacheEntry *lruPrev; // Towards more recently used
+  struct CacheEntry *lruNext; // Towards less recently used
+} CacheEntry;
+
+static size_t       decodeCacheSize;
+static size_t       cacheUsed;
+static CacheEntry  *cacheEntries;
+static CacheEntry **cacheBuckets;
+static size_t       cacheBucketMask;
+static CacheEntry  *lruHead; // Most recently used
+static CacheEntry  *lruTail; // Least recently used
+
+static uint64_t cacheHits;
+static uint64_t cacheMisses;
+static uint64_t cacheEvictions;
+
+extern void decodeCacheInit(size_t entries)
+{
+  size_t buckets;
+
+  if (entries == 0)
+  {
+    return;
+  }
+
+  for (buckets = 16; buckets < entries * 2; buckets *= 2)
+    ;
+
+  cacheEntries = calloc(entries, sizeof(CacheEntry));
+  cacheBuckets = calloc(buckets, sizeof(CacheEntry *));
+  if (cacheEntries == NULL || cacheBuckets == NULL)
+  {
+    die("Out of memory");
+  }
+  decodeCacheSize = entries;
+  cacheBucketMask = buckets - 1;
+  logDebug("Decode cache enabled with %zu entries and %zu buckets\n", entries, buckets);
+}
+
+extern bool decodeCacheEnabled(void)
+{
+  return decodeCacheSize > 0;
+}
+
+extern void decodeCacheKey(DecodeCacheKey *key, OutputMode mode, uint32_t pgn, uint8_t src, const uint8_t *data, size_t dataLen)
+{
+  uint64_t hash = HASH_INIT;
+
+  hash = hashBytes(hash, &mode, sizeof(mode));
+  hash = hashBytes(hash, &pgn, sizeof(pgn));
+  hash = hashBytes(hash, &src, sizeof(src));
+  hash = hashBytes(hash, data, dataLen);
+
+  key->hash    = hash;
+  key->mode    = mode;
+  key->pgn     = pgn;
+  key->src     = src;
+  key->data    = data;
+  key->dataLen = dataLen;
+}
+
+static void lruUnlink(CacheEntry *e)
+{
+  if (e->lruPrev != NULL)
+  {
+    e->lruPrev->lruNext = e->lruNext;
+  }
+  else
+  {
+    lruHead = e->lruNext;
+  }
+  if (e->lruNext != NULL)
+  {
+    e->lruNext->lruPrev = e->lruPrev;
+  }
+  else
+  {
+    lruTail = e->lruPrev;
+  }
+  e->lruPrev = NULL;
+  e->lruNext = NULL;
+}
+
+static void lruPushFront(CacheEntry *e)
+{
+  e->lruPrev = NULL;
+  e->lruNext = lruHead;
+  if (lruHead != NULL)
+  {
+    lruHead->lruPrev = e;
+  }
+  lruHead = e;
+  if (lruTail == NULL)
+  {
+    lruTail = e;
+  }
+}
+
+static void bucketUnlink(CacheEntry *e)
+{
+  CacheEntry **p;
+
+  for (p = &cacheBuckets[e->hash & cacheBucketMask]; *p != NULL; p = &(*p)->hashNext)
+  {
+    if (*p == e)
+    {
+      *p = e->hashNext;
+      break;
+    }
+  }
+  e->hashNext = NULL;
+}
+
+/*
+ * Return the cached field section for this key, or NULL when it is not cached.
+ */
+extern const char *decodeCacheLookup(const DecodeCacheKey *key, size_t *textLen)
+{
+  CacheEntry *e;
+
+  for (e = cacheBuckets[key->hash & cacheBucketMask]; e != NULL; e = e->hashNext)
+  {
+    if (e->hash == key->hash && e->mode == key->mode && e->pgn == key->pgn && e->src == key->src && e->dataLen == key->dataLen
+        && memcmp(e->data, key->data, key->dataLen) == 0)
+    {
+      if (e != lruHead)
+      {
+        lruUnlink(e);
+        lruPushFront(e);
+      }
+      cacheHits++;
+      *textLen = e->textLen;
+      return e->text;
+    }
+  }
+  cacheMisses++;
+  return NULL;
+}
+
+extern void decodeCacheStore(const DecodeCacheKey *key, const char *text, size_t textLen)
+{
+  CacheEntry *e;
+
+  if (key->dataLen > sizeof(e->data))
+  {
+    return;
+  }
+
+  if (cacheUsed < decodeCacheSize)
+  {
+    e = &cacheEntries[cacheUsed++];
+  }
+  else
+  {
+    e = lruTail;
+    lruUnlink(e);
+    bucketUnlink(e);
+    cacheEvictions++;
+  }
+
+  if (e->textAlloc < textLen)
+  {
+    e->text = realloc(e->text, textLen);
+    if (e->text == NULL)
+    {
+      die("Out of memory");
+    }
+    e->textAlloc = textLen;
+  }
+  memcpy(e->text, text, textLen);
+  e->textLen = textLen;
+
+  e->hash    = key->hash;
+  e->mode    = key->mode;
+  e->pgn     = key->pgn;
+  e->src     = key->src;
+  e->dataLen = key->dataLen;
+  memcpy(e->data, key->data, key->dataLen);
+
+  e->hashNext                             = cacheBuckets[e->hash & cacheBucketMask];
+  cacheBuckets[e->hash & cacheBucketMask] = e;
+  lruPushFront(e);
+}
+
+extern void decodeCacheStatistics(void)
+{
+  if (decodeCacheSize > 0)
+  {
+    logInfo("Decode cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions, %zu/%zu entries used\n",
+            cacheHits,
+            cacheMisses,
+            cacheEvictions,
+            cacheUsed,
+            decodeCacheSize);
+  }
+}
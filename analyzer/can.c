@@ -0,0 +1,253 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * SocketCAN input.
+ *
+ * With -can <interface> analyzer reads the CAN frames from a raw CAN socket instead of a log,
+ * so `candump | candump2analyzer | analyzer` is not needed. The frames are read CAN_BATCH at
+ * a time with recvmmsg() and turned into messages directly, without formatting and parsing
+ * them as text.
+ *
+ * Every frame gets the receive timestamp of the kernel, requested with SO_TIMESTAMPING. When
+ * the interface provides a hardware timestamp that is close to the kernel time it is used
+ * instead, as not all CAN interfaces keep their clock in UTC.
+ *
+ * Only frames with a 29 bit identifier are used. analyzer stops on SIGINT or SIGTERM after
+ * printing what it has. It can be tried on a virtual interface:
+ *
+ *   ip link add dev vcan0 type vcan && ip link set up vcan0
+ *   analyzer -can vcan0 &
+ *   socketcan-writer vcan0 < log.txt
+ */
+
+#define _GNU_SOURCE // For recvmmsg()
+#include "analyzer.h"
+
+#ifdef __linux__
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <net/if.h>
+#include <signal.h>
+#include <sys/socket.h>
+#endif
+
+#define CAN_BATCH (32)
+#define CAN_HW_TIME_SKEW_MS (1000) // How far a hardware timestamp can be from the kernel time
+
+static const char *canInterface;
+
+extern void canSetInterface(const char *name)
+{
+  canInterface = name;
+}
+
+extern bool canEnabled(void)
+{
+  return canInterface != NULL;
+}
+
+#ifdef __linux__
+
+static int                   canSocket = -1;
+static struct mmsghdr        canMsgs[CAN_BATCH];
+static struct iovec          canIov[CAN_BATCH];
+static struct can_frame      canFrames[CAN_BATCH];
+static char                  canControl[CAN_BATCH][CMSG_SPACE(sizeof(struct scm_timestamping))];
+static int                   canCount; // Frames in the batch
+static int                   canNextFrame;
+static volatile sig_atomic_t canStop;
+
+static void canSignal(int sig)
+{
+  (void) sig;
+  canStop = 1;
+}
+
+extern void canOpen(void)
+{
+  struct sockaddr_can addr;
+  struct sigaction    sa;
+  int                 flags
+      = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+  canSocket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (canSocket < 0)
+  {
+    logAbort("Cannot open CAN socket: %s\n", strerror(errno));
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family  = AF_CAN;
+  addr.can_ifindex = if_nametoindex(canInterface);
+  if (addr.can_ifindex == 0)
+  {
+    logAbort("Unknown CAN interface '%s'\n", canInterface);
+  }
+  if (bind(canSocket, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+  {
+    logAbort("Cannot bind to CAN interface '%s': %s\n", canInterface, strerror(errno));
+  }
+  if (setsockopt(canSocket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+  {
+    logInfo("Kernel receive timestamps are not available on '%s', using the time of reading\n", canInterface);
+  }
+
+  for (int i = 0; i < CAN_BATCH; i++)
+  {
+    canIov[i].iov_base                = &canFrames[i];
+    canIov[i].iov_len                 = sizeof(canFrames[i]);
+    canMsgs[i].msg_hdr.msg_iov        = &canIov[i];
+    canMsgs[i].msg_hdr.msg_iovlen     = 1;
+    canMsgs[i].msg_hdr.msg_control    = canControl[i];
+    canMsgs[i].msg_hdr.msg_controllen = sizeof(canControl[i]);
+  }
+
+  // Stop reading, instead of being killed, so the output is complete
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = canSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  logDebug("Reading CAN frames from '%s'\n", canInterface);
+}
+
+static bool readBatch(void)
+{
+  for (int i = 0; i < CAN_BATCH; i++)
+  {
+    canMsgs[i].msg_hdr.msg_controllen = sizeof(canControl[i]);
+  }
+
+  // Nothing is printed while waiting, so let the reader see what there is
+  fflush(stdout);
+
+  while (!canStop)
+  {
+    int n = recvmmsg(canSocket, canMsgs, CAN_BATCH, MSG_WAITFORONE, NULL);
+
+    if (n > 0)
+    {
+      canCount     = n;
+      canNextFrame = 0;
+      return true;
+    }
+    if (n < 0 && errno != EINTR)
+    {
+      logAbort("Cannot read from CAN interface '%s': %s\n", canInterface, strerror(errno));
+    }
+  }
+  return false;
+}
+
+static uint64_t frameTime(struct msghdr *hdr)
+{
+  uint64_t        software = 0;
+  uint64_t        hardware = 0;
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING)
+    {
+      struct scm_timestamping ts;
+
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      software = (uint64_t) ts.ts[0].tv_sec * 1000 + ts.ts[0].tv_nsec / 1000000;
+      hardware = (uint64_t) ts.ts[2].tv_sec * 1000 + ts.ts[2].tv_nsec / 1000000;
+    }
+  }
+
+  if (software == 0)
+  {
+    return getNow();
+  }
+  if (hardware != 0 && hardware + CAN_HW_TIME_SKEW_MS > software && hardware < software + CAN_HW_TIME_SKEW_MS)
+  {
+    return hardware;
+  }
+  return software;
+}
+
+/*
+ * Read the next frame as a message. When <line> is not NULL it is set to the frame in PLAIN
+ * format, for the raw output sinks. Returns false when analyzer is asked to stop.
+ */
+extern bool canNext(RawMessage *msg, char *line, size_t size)
+{
+  for (;;)
+  {
+    struct can_frame *frame;
+    unsigned int      prio;
+    unsigned int      pgn;
+    unsigned int      src;
+    unsigned int      dst;
+
+    if (canNextFrame >= canCount && !readBatch())
+    {
+      return false;
+    }
+    frame = &canFrames[canNextFrame];
+    if ((frame->can_id & CAN_EFF_FLAG) == 0 || (frame->can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0)
+    {
+      canNextFrame++;
+      continue;
+    }
+
+    getISO11783BitsFromCanId(frame->can_id & CAN_EFF_MASK, &prio, &pgn, &src, &dst);
+    msg->prio = prio;
+    msg->pgn  = pgn;
+    msg->src  = src;
+    msg->dst  = dst;
+    msg->len  = CB_MIN(frame->can_dlc, 8);
+    memcpy(msg->data, frame->data, msg->len);
+    storeTimestamp(msg->timestamp, frameTime(&canMsgs[canNextFrame].msg_hdr));
+    canNextFrame++;
+
+    if (line != NULL)
+    {
+      size_t len = snprintf(line, size, "%s,%u,%u,%u,%u,%u", msg->timestamp, prio, pgn, src, dst, msg->len);
+
+      for (size_t i = 0; i < msg->len && len < size; i++)
+      {
+        len += snprintf(line + len, size - len, ",%02x", msg->data[i]);
+      }
+    }
+    return true;
+  }
+}
+
+#else
+
+extern void canOpen(void)
+{
+  logAbort("-can is only available on Linux\n");
+}
+
+extern bool canNext(RawMessage *msg, char *line, size_t size)
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,275 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Deadband output filtering.
+ *
+ * A deadband file contains rules of the form
+ *
+ *   # pgn  field    deadband  [interval]
+ *   127250 heading  0.5
+ *   128267 depth    0.1       10
+ *
+ * The field is named as by -camel (the original field name is also accepted), and can only
+ * have one rule. The deadband is in the unit that analyzer prints the field in, so it
+ * depends on -si. The optional interval is in seconds.
+ *
+ * A message of a PGN that has rules is only printed when one of its rule fields differs
+ * by more than the deadband from the value in the last message of that PGN, source and
+ * instance (when the PGN has an instance field) that was printed, or when the interval of one of its rules has passed since then.
+ * The comparison is done on the raw integer values, before any formatting.
+ */
+
+#include "analyzer.h"
+
+typedef struct DeadbandRule
+{
+  const Field *field;
+  size_t       startBit;
+  int64_t      deadband; // Raw units
+  uint64_t     interval; // Milliseconds, 0 = none
+} DeadbandRule;
+
+typedef struct DeadbandState
+{
+  struct DeadbandState *next; // Next instance of the same source
+  int64_t               instance;
+  bool                  valid;
+  uint64_t              lastTime; // Timestamp of last printed message, in milliseconds
+  int64_t               value[];  // Value of each rule field in the last printed message
+} DeadbandState;
+
+typedef struct DeadbandRuleSet
+{
+  size_t         count;
+  DeadbandRule  *rule;
+  const Field   *instanceField; // NULL when the PGN has no instance
+  size_t         instanceStartBit;
+  DeadbandState *state[256]; // Per source address
+} DeadbandRuleSet;
+
+static DeadbandRuleSet **ruleSets; // Indexed by position in pgnList, NULL if PGN has no rules
+
+static void addRule(const char *filename, int line, Pgn *pgn, Field *field, double deadband, double interval)
+{
+  DeadbandRuleSet *set;
+  DeadbandRule    *rule;
+  double           resolution = (field->resolution != 0.0) ? field->resolution : 1.0;
+
+  if (!isNumericField(field))
+  {
+    logAbort("%s:%d: field '%s' of PGN %u is not a numeric field\n", filename, line, field->name, pgn->pgn);
+  }
+
+  set = ruleSets[pgn - pgnList];
+  if (set == NULL)
+  {
+    set = calloc(1, sizeof(DeadbandRuleSet));
+    if (set == NULL)
+    {
+      die("Out of memory");
+    }
+    for (size_t i = 0; i < pgn->fieldCount && getFixedStartBit(pgn, &pgn->fieldList[i], &set->instanceStartBit); i++)
+    {
+      if (isInstanceField(&pgn->fieldList[i]))
+      {
+        set->instanceField = &pgn->fieldList[i];
+        break;
+      }
+    }
+    ruleSets[pgn - pgnList] = set;
+  }
+  for (size_t i = 0; i < set->count; i++)
+  {
+    if (set->rule[i].field == field)
+    {
+      logAbort("%s:%d: field '%s' of PGN %u already has a deadband rule\n", filename, line, field->name, pgn->pgn);
+    }
+  }
+  set->rule = realloc(set->rule, (set->count + 1) * sizeof(DeadbandRule));
+  if (set->rule == NULL)
+  {
+    die("Out of memory");
+  }
+  rule = &set->rule[set->count++];
+
+  if (!getFixedStartBit(pgn, field, &rule->startBit))
+  {
+    logAbort("%s:%d: field '%s' of PGN %u is not at a fixed position\n", filename, line, field->name, pgn->pgn);
+  }
+  rule->field    = field;
+  rule->deadband = (int64_t) floor(deadband / fabs(resolution) + 1e-9);
+  rule->interval = (uint64_t) (interval * 1000.0);
+  logDebug("Deadband PGN %u field '%s' raw deadband %" PRId64 " interval %" PRIu64 " ms\n",
+           pgn->pgn,
+           field->name,
+           rule->deadband,
+           rule->interval);
+}
+
+extern void deadbandLoad(const char *filename)
+{
+  FILE *file;
+  char  line[256];
+  int   lineNumber = 0;
+
+  file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    logAbort("Cannot open deadband file '%s'\n", filename);
+  }
+
+  ruleSets = calloc(pgnListSize, sizeof(DeadbandRuleSet *));
+  if (ruleSets == NULL)
+  {
+    die("Out of memory");
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    unsigned int prn;
+    char         name[80];
+    double       deadband;
+    double       interval = 0.0;
+    bool         found    = false;
+    int          n;
+
+    lineNumber++;
+    if (sscanf(line, " %1[#]", name) == 1)
+    {
+      continue;
+    }
+    n = sscanf(line, "%u %79s %lf %lf", &prn, name, &deadband, &interval);
+    if (n == EOF)
+    {
+      continue;
+    }
+    if (n < 3 || deadband < 0.0 || interval < 0.0)
+    {
+      logAbort("%s:%d: expected '<pgn> <field> <deadband> [<interval>]'\n", filename, lineNumber);
+    }
+
+    // There can be multiple definitions for the same PGN (proprietary variants)
+    for (size_t i = 0; i < pgnListSize; i++)
+    {
+      if (pgnList[i].pgn != prn || pgnList[i].fallback)
+      {
+        continue;
+      }
+      for (size_t j = 0; j < pgnList[i].fieldCount; j++)
+      {
+        if (fieldNameMatches(&pgnList[i].fieldList[j], name))
+        {
+          addRule(filename, lineNumber, &pgnList[i], &pgnList[i].fieldList[j], deadband, interval);
+          found = true;
+          break;
+        }
+      }
+    }
+    if (!found)
+    {
+      logAbort("%s:%d: PGN %u has no field '%s'\n", filename, lineNumber, prn, name);
+    }
+  }
+  fclose(file);
+}
+
+/*
+ * Return true when this message should not be printed because none of the fields that
+ * have deadband rules changed enough, and no rule interval has passed.
+ */
+extern bool deadbandSuppress(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length)
+{
+  DeadbandRuleSet *set;
+  DeadbandState   *state;
+  int64_t          value[ARRAY_SIZE(pgn->fieldList)]; // A field has at most one rule
+  int64_t          maxValue;
+  uint64_t         now;
+  bool             haveTime;
+  int64_t          instance = -1;
+  bool             print    = false;
+  size_t           i;
+
+  if (ruleSets == NULL || (set = ruleSets[pgn - pgnList]) == NULL)
+  {
+    return false;
+  }
+
+  if (set->instanceField != NULL)
+  {
+    extractNumber(set->instanceField, data, length, set->instanceStartBit, set->instanceField->size, &instance, &maxValue);
+  }
+  state = set->state[msg->src];
+  while (state != NULL && state->instance != instance)
+  {
+    state = state->next;
+  }
+  if (state == NULL)
+  {
+    state = calloc(1, sizeof(DeadbandState) + set->count * sizeof(int64_t));
+    if (state == NULL)
+    {
+      die("Out of memory");
+    }
+    state->instance      = instance;
+    state->next          = set->state[msg->src];
+    set->state[msg->src] = state;
+  }
+
+  for (i = 0; i < set->count; i++)
+  {
+    const DeadbandRule *rule = &set->rule[i];
+
+    if (!extractNumber(rule->field, data, length, rule->startBit, rule->field->size, &value[i], &maxValue))
+    {
+      return false; // Cannot judge a message that is too short, so print it
+    }
+    if (!state->valid || value[i] - state->value[i] > rule->deadband || state->value[i] - value[i] > rule->deadband)
+    {
+      print = true;
+    }
+  }
+
+  haveTime = parseTimestamp(msg->timestamp, &now);
+  if (!print && haveTime)
+  {
+    for (i = 0; i < set->count; i++)
+    {
+      if (set->rule[i].interval != 0 && (now < state->lastTime || now - state->lastTime >= set->rule[i].interval))
+      {
+        print = true;
+        break;
+      }
+    }
+  }
+
+  if (!print)
+  {
+    logDebug("Deadband: suppress PGN %u from %u\n", msg->pgn, msg->src);
+    return true;
+  }
+
+  memcpy(state->value, value, set->count * sizeof(int64_t));
+  state->lastTime = haveTime ? now : 0;
+  state->valid    = true;
+  return false;
+}
@@ -0,0 +1,135 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Duplicate frame suppression.
+ *
+ * When two gateways are connected to the same bus, or a bus is bridged, every frame is
+ * logged twice with slightly different timestamps. With -dedup <window> a frame is dropped
+ * when a frame with the same PGN, source, destination and data was seen less than <window>
+ * (e.g. 50ms) before or after it, in the same log or in another -file that is merged.
+ *
+ * The decision is made on the raw frames, before fast packet reassembly. The frames of a
+ * fast packet differ in their sequence number, so each copy of a frame is matched with the
+ * same frame of the other copy.
+ *
+ * The frames that were seen are remembered in a fixed size table of DEDUP_SETS sets of
+ * DEDUP_WAYS entries, indexed by a hash of the frame. When a set is full the oldest entry
+ * is replaced, so on a very busy bus a duplicate may occasionally be let through, but the
+ * memory and time used per frame stay constant. Frames without a timestamp that can be
+ * parsed are never dropped.
+ */
+
+#include "analyzer.h"
+
+#define DEDUP_SETS (4096)
+#define DEDUP_WAYS (2)
+
+typedef struct DedupEntry
+{
+  uint64_t hash; // 0 = entry not used
+  uint64_t time; // Milliseconds
+} DedupEntry;
+
+static uint64_t   dedupWindow; // Milliseconds, 0 = disabled
+static DedupEntry dedupTable[DEDUP_SETS][DEDUP_WAYS];
+static uint64_t   dedupDropped[MERGE_MAX_INPUTS];
+
+extern void dedupInit(const char *window)
+{
+  if (!parseDuration(window, &dedupWindow))
+  {
+    logAbort("Invalid dedup window '%s'\n", window);
+  }
+  logDebug("Dedup: dropping repeated frames within %" PRIu64 " ms\n", dedupWindow);
+}
+
+extern bool dedupEnabled(void)
+{
+  return dedupWindow != 0;
+}
+
+static uint64_t frameHash(const RawMessage *msg)
+{
+  uint64_t hash = HASH_INIT;
+
+  hash = hashBytes(hash, &msg->pgn, sizeof(msg->pgn));
+  hash = hashBytes(hash, &msg->src, sizeof(msg->src));
+  hash = hashBytes(hash, &msg->dst, sizeof(msg->dst));
+  hash = hashBytes(hash, &msg->len, sizeof(msg->len));
+  hash = hashBytes(hash, msg->data, msg->len);
+  return hash | 1; // Never 0
+}
+
+/*
+ * Return true when this frame of input <input> is a copy of a frame seen within the window.
+ */
+extern bool dedupDrop(const RawMessage *msg, size_t input)
+{
+  uint64_t    now;
+  uint64_t    hash;
+  DedupEntry *set;
+  DedupEntry *oldest;
+
+  if (dedupWindow == 0 || !parseTimestamp(msg->timestamp, &now))
+  {
+    return false;
+  }
+
+  hash   = frameHash(msg);
+  set    = dedupTable[(hash >> 32) % DEDUP_SETS];
+  oldest = &set[0];
+  for (size_t i = 0; i < DEDUP_WAYS; i++)
+  {
+    if (set[i].hash == hash)
+    {
+      uint64_t age = (now > set[i].time) ? now - set[i].time : set[i].time - now;
+
+      if (age < dedupWindow)
+      {
+        dedupDropped[input]++;
+        return true;
+      }
+      oldest = &set[i];
+      break;
+    }
+    if (set[i].hash == 0 || set[i].time < oldest->time)
+    {
+      oldest = &set[i];
+    }
+  }
+
+  oldest->hash = hash;
+  oldest->time = now;
+  return false;
+}
+
+extern void dedupStatistics(void)
+{
+  for (size_t i = 0; i < MERGE_MAX_INPUTS; i++)
+  {
+    if (dedupDropped[i] > 0)
+    {
+      logInfo("Dedup: dropped %" PRIu64 " duplicate frames of input %zu\n", dedupDropped[i], i + 1);
+    }
+  }
+}
@@ -0,0 +1,435 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * On-disk output cache.
+ *
+ * With -cache-dir <dir> the output that is written to stdout is stored in <dir>, so a later
+ * run over the same input with the same options prints it without decoding.
+ *
+ * The input is divided in chunks of about DISK_CACHE_CHUNK_SIZE bytes of complete lines. The
+ * entry for a chunk is stored under a hash of:
+ *   - the analyzer version, schema version and a checksum of the analyzer sources, so that
+ *     any change to the PGN database or to the way it is printed invalidates the cache;
+ *   - the command line options, except -file, -cache-dir, -d and -q;
+ *   - the hashes of all chunks before it.
+ * The entry holds the hash and length of the chunk's input lines, the output and the decoder
+ * state at the end of the chunk (see diskCacheState). When the input lines match, the output
+ * is printed and the state is restored; otherwise the lines are decoded as usual. A log that
+ * was appended to is therefore only decoded from the last chunk that changed.
+ *
+ * Only stdout is cached, so messages on stderr are not repeated for chunks that are served
+ * from the cache. The hashes are the 64 bit FNV-1a of hashBytes(), which is fine for telling
+ * logs apart but is not meant to resist deliberately crafted input.
+ */
+
+#include "analyzer.h"
+
+#define DISK_CACHE_CHUNK_SIZE (1024 * 1024)
+#define DISK_CACHE_MAGIC "N2KCCH01"
+#define DISK_CACHE_MAGIC_LEN (8)
+#define DISK_CACHE_SUFFIX ".n2kc"
+#define DISK_CACHE_MAX_STATE (8)
+
+#ifndef ANALYZER_SOURCE_HASH
+#define ANALYZER_SOURCE_HASH "unknown"
+#endif
+
+typedef struct DiskCacheHeader
+{
+  char     magic[DISK_CACHE_MAGIC_LEN];
+  uint64_t base;      // Hash of the versions and options
+  uint64_t prefix;    // Hash of the chunks before this one
+  uint64_t chunkHash; // Hash of the input lines of this chunk
+  uint64_t chunkLen;  // Length of the input lines of this chunk
+  uint64_t outputLen; // Length of the output, followed by the state
+  uint64_t stateLen;
+} DiskCacheHeader;
+
+typedef struct DiskCacheState
+{
+  void  *data;
+  size_t len;
+} DiskCacheState;
+
+static const char    *cacheDir;
+static uint64_t       base = HASH_INIT;
+static DiskCacheState state[DISK_CACHE_MAX_STATE];
+static size_t         stateCount;
+static size_t         stateLen;
+
+static uint64_t prefix; // Hash of all chunks so far
+static bool     recording;
+static uint64_t chunkHash;
+static uint64_t chunkLen;
+static FILE    *entry; // Entry being written, or NULL when it failed
+static char     entryTmp[1024];
+static uint64_t outputLen;
+
+static char  *replay; // Lines that were read to check an entry that did not match
+static size_t replayLen;
+static size_t replayPos;
+static size_t replayAlloc;
+
+static uint64_t chunksServed;
+static uint64_t chunksStored;
+
+extern void diskCacheSetDir(const char *dir)
+{
+  cacheDir = dir;
+}
+
+extern bool diskCacheEnabled(void)
+{
+  return cacheDir != NULL;
+}
+
+/*
+ * Hash the versions and the options that can change the output.
+ */
+extern void diskCacheSetOptions(int argc, char **argv)
+{
+  static const char versions[] = VERSION "\n" SCHEMA_VERSION "\n" ANALYZER_SOURCE_HASH "\n";
+
+  base = hashBytes(HASH_INIT, versions, sizeof(versions));
+  for (int i = 1; i < argc; i++)
+  {
+    if (i + 1 < argc && (strcasecmp(argv[i], "-file") == 0 || strcasecmp(argv[i], "-cache-dir") == 0))
+    {
+      i++;
+      continue;
+    }
+    if (strcasecmp(argv[i], "-d") == 0 || strcasecmp(argv[i], "-q") == 0)
+    {
+      continue; // Only change the logging on stderr
+    }
+    base = hashBytes(base, argv[i], strlen(argv[i]) + 1);
+  }
+}
+
+/*
+ * Register decoder state that carries over from one line to the next. It is saved with
+ * every entry and restored when the entry is used, so it must not contain pointers.
+ */
+extern void diskCacheState(void *data, size_t len)
+{
+  if (stateCount == DISK_CACHE_MAX_STATE)
+  {
+    logAbort("Too much decoder state for the cache\n");
+  }
+  state[stateCount].data = data;
+  state[stateCount].len  = len;
+  stateCount++;
+  stateLen += len;
+}
+
+extern void diskCacheOpen(void)
+{
+  if (cacheDir == NULL)
+  {
+    return;
+  }
+  if (mkdir(cacheDir, 0777) != 0 && errno != EEXIST)
+  {
+    logAbort("Cannot create directory '%s': %s\n", cacheDir, strerror(errno));
+  }
+  prefix = base;
+}
+
+static void entryName(char *name, size_t size)
+{
+  uint64_t key = hashBytes(base, &prefix, sizeof(prefix));
+
+  snprintf(name, size, "%s/%016" PRIx64 DISK_CACHE_SUFFIX, cacheDir, key);
+}
+
+static void nextPrefix(void)
+{
+  prefix = hashBytes(prefix, &chunkHash, sizeof(chunkHash));
+  prefix = hashBytes(prefix, &chunkLen, sizeof(chunkLen));
+}
+
+static void replayAppend(const char *line, size_t len)
+{
+  if (replayLen + len > replayAlloc)
+  {
+    replayAlloc = CB_MAX(replayAlloc * 2, replayLen + len + DISK_CACHE_CHUNK_SIZE);
+    replay      = realloc(replay, replayAlloc);
+    if (replay == NULL)
+    {
+      die("Out of memory");
+    }
+  }
+  memcpy(replay + replayLen, line, len);
+  replayLen += len;
+}
+
+/*
+ * Print the output of the entry for the chunk that starts here, when the input matches.
+ * The input lines that were read to check this are kept for replay when it does not.
+ */
+static bool chunkServe(char *line, int size, FILE *file)
+{
+  char            name[1024];
+  FILE           *f;
+  DiskCacheHeader header;
+  struct stat     st;
+  uint64_t        hash = HASH_INIT;
+  char            buf[64 * 1024];
+
+  entryName(name, sizeof(name));
+  f = fopen(name, "rb");
+  if (f == NULL)
+  {
+    return false;
+  }
+  if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, DISK_CACHE_MAGIC, DISK_CACHE_MAGIC_LEN) != 0
+      || header.base != base || header.prefix != prefix || header.stateLen != stateLen || fstat(fileno(f), &st) != 0
+      || (uint64_t) st.st_size != sizeof(header) + header.outputLen + header.stateLen)
+  {
+    fclose(f);
+    return false;
+  }
+
+  while (replayLen < header.chunkLen && rangeReadLine(line, size, file) != NULL)
+  {
+    replayAppend(line, strlen(line));
+  }
+  hash = hashBytes(hash, replay, replayLen);
+  if (replayLen != header.chunkLen || hash != header.chunkHash)
+  {
+    logDebug("Cache entry %s does not match the input\n", name);
+    fclose(f);
+    return false;
+  }
+
+  for (uint64_t left = header.outputLen; left > 0;)
+  {
+    size_t n = fread(buf, 1, CB_MIN(left, sizeof(buf)), f);
+
+    if (n == 0)
+    {
+      logAbort("Cannot read cache entry '%s'\n", name);
+    }
+    fwrite(buf, 1, n, stdout);
+    left -= n;
+  }
+  for (size_t i = 0; i < stateCount; i++)
+  {
+    if (fread(state[i].data, state[i].len, 1, f) != 1)
+    {
+      logAbort("Cannot read cache entry '%s'\n", name);
+    }
+  }
+  fflush(stdout);
+  fclose(f);
+
+  chunkHash = header.chunkHash;
+  chunkLen  = header.chunkLen;
+  nextPrefix();
+  replayLen = 0;
+  chunksServed++;
+  return true;
+}
+
+static void entryFailed(const char *what)
+{
+  logError("Cannot %s cache entry '%s': %s\n", what, entryTmp, strerror(errno));
+  if (entry != NULL)
+  {
+    fclose(entry);
+    entry = NULL;
+  }
+  remove(entryTmp);
+}
+
+static void chunkStart(void)
+{
+  DiskCacheHeader header;
+
+  recording = true;
+  chunkHash = HASH_INIT;
+  chunkLen  = 0;
+  outputLen = 0;
+
+  snprintf(entryTmp, sizeof(entryTmp), "%s/%016" PRIx64 ".tmp.%ld", cacheDir, prefix, (long) getpid());
+  entry = fopen(entryTmp, "wb");
+  memset(&header, 0, sizeof(header));
+  if (entry == NULL || fwrite(&header, sizeof(header), 1, entry) != 1) // Rewritten when the chunk is complete
+  {
+    entryFailed("create");
+  }
+}
+
+static void chunkFinish(bool complete)
+{
+  DiskCacheHeader header;
+  char            name[1024];
+
+  recording = false;
+  if (entry == NULL)
+  {
+    nextPrefix();
+    return;
+  }
+  if (!complete)
+  {
+    fclose(entry);
+    entry = NULL;
+    remove(entryTmp);
+    return;
+  }
+
+  memcpy(header.magic, DISK_CACHE_MAGIC, DISK_CACHE_MAGIC_LEN);
+  header.base      = base;
+  header.prefix    = prefix;
+  header.chunkHash = chunkHash;
+  header.chunkLen  = chunkLen;
+  header.outputLen = outputLen;
+  header.stateLen  = stateLen;
+  entryName(name, sizeof(name));
+  nextPrefix();
+
+  for (size_t i = 0; i < stateCount; i++)
+  {
+    if (fwrite(state[i].data, state[i].len, 1, entry) != 1)
+    {
+      entryFailed("write");
+      return;
+    }
+  }
+  if (fseek(entry, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, entry) != 1)
+  {
+    entryFailed("write");
+    return;
+  }
+  if (fclose(entry) != 0)
+  {
+    entry = NULL;
+    entryFailed("write");
+    return;
+  }
+  entry = NULL;
+  if (rename(entryTmp, name) != 0)
+  {
+    entryFailed("rename");
+    return;
+  }
+  chunksStored++;
+}
+
+/*
+ * Read the next line of the input, like fgets(), after printing the output of the chunks
+ * that are in the cache.
+ */
+extern char *diskCacheReadLine(char *line, int size, FILE *file)
+{
+  size_t len;
+
+  if (cacheDir == NULL)
+  {
+    return rangeReadLine(line, size, file);
+  }
+
+  for (;;)
+  {
+    if (recording && chunkLen >= DISK_CACHE_CHUNK_SIZE)
+    {
+      chunkFinish(true);
+    }
+    if (!recording)
+    {
+      if (replayLen == replayPos && chunkServe(line, size, file))
+      {
+        continue;
+      }
+      chunkStart();
+    }
+    break;
+  }
+
+  if (replayPos < replayLen)
+  {
+    const char *nl;
+
+    // Return the same pieces as fgets() did when the lines were read
+    len = CB_MIN(replayLen - replayPos, (size_t) size - 1);
+    nl  = memchr(replay + replayPos, '\n', len);
+    if (nl != NULL)
+    {
+      len = nl - (replay + replayPos) + 1;
+    }
+    memcpy(line, replay + replayPos, len);
+    line[len] = '\0';
+    replayPos += len;
+    if (replayPos == replayLen)
+    {
+      replayPos = 0;
+      replayLen = 0;
+    }
+  }
+  else if (rangeReadLine(line, size, file) == NULL)
+  {
+    return NULL;
+  }
+  else
+  {
+    len = strlen(line);
+  }
+
+  chunkHash = hashBytes(chunkHash, line, len);
+  chunkLen += len;
+  return line;
+}
+
+/*
+ * Store output that is written to stdout in the entry of the current chunk.
+ */
+extern void diskCacheCapture(const char *data, size_t len)
+{
+  if (entry == NULL)
+  {
+    return;
+  }
+  if (fwrite(data, 1, len, entry) != len)
+  {
+    entryFailed("write");
+    return;
+  }
+  outputLen += len;
+}
+
+/*
+ * Store the last chunk, when the whole input was read.
+ */
+extern void diskCacheClose(bool complete)
+{
+  if (cacheDir == NULL)
+  {
+    return;
+  }
+  if (recording)
+  {
+    chunkFinish(complete && chunkLen > 0);
+  }
+  logDebug("Cache: %" PRIu64 " chunks printed from the cache, %" PRIu64 " chunks stored\n", chunksServed, chunksStored);
+}
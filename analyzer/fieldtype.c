@@ -183,6 +183,28 @@ static void fixupUnit(Field *f)
   }
 }
 
+/*
+ * Return how many of the highest raw values of a byte aligned unsigned field are not printed
+ * as a value ("not available" and "error"), or 0 when this cannot be decided from the
+ * bytes alone. See fieldNotAvailable().
+ */
+static uint8_t getNotAvailable(const Field *f)
+{
+  if (f->size % 8 != 0 || f->size < 8 || f->size > 64 || f->hasSign || f->offset != 0)
+  {
+    return 0;
+  }
+  if (f->ft->pf == fieldPrintReserved)
+  {
+    return 1;
+  }
+  if (f->ft->pf == fieldPrintNumber || f->ft->pf == fieldPrintMMSI || f->ft->pf == fieldPrintTime)
+  {
+    return 2;
+  }
+  return 0;
+}
+
 extern void fillFieldType(bool doUnitFixup)
 {
   // Percolate fields from physical quantity to fieldtype
@@ -259,6 +281,10 @@ extern void fillFieldType(bool doUnitFixup)
     {
       logAbort("FieldType '%s' has no print function\n", ft->name);
     }
+    for (size_t mode = 0; mode < OUTPUT_MODE_COUNT; mode++)
+    {
+      ft->pfMode[mode] = getFieldPrinter(ft->pf, (OutputMode) mode);
+    }
 
     // Set the field range
     if (ft->size != 0 && ft->resolution != 0.0 && ft->hasSign != Null && ft->rangeMax == 0.0)
@@ -375,8 +401,9 @@ extern void fillFieldType(bool doUnitFixup)
         f->rangeMax = getMaxRange(f->name, f->size, f->resolution, f->hasSign, f->offset, &f->lookup);
       }
 
-      f->pgn   = &pgnList[i];
-      f->order = j + 1;
+      f->pgn          = &pgnList[i];
+      f->order        = j + 1;
+      f->notAvailable = getNotAvailable(f);
     }
     if (pgnList[i].type == PACKET_FAST && !ALLOW_PGN_FAST_PACKET(pgn))
     {
@@ -29,6 +29,19 @@ limitations under the License.
 
 typedef bool (*FieldPrintFunctionType)(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits);
 
+/*
+ * The field printers are compiled once per output mode, see print.c.
+ */
+typedef enum OutputMode
+{
+  OUTPUT_TEXT,
+  OUTPUT_JSON,
+  OUTPUT_JSON_EMPTY,
+  OUTPUT_JSON_NV,
+  OUTPUT_JSON_NV_EMPTY,
+  OUTPUT_MODE_COUNT
+} OutputMode;
+
 extern bool fieldPrintBinary(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits);
 extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits);
 extern bool fieldPrintDate(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits);
@@ -317,7 +330,8 @@ struct FieldType
   const PhysicalQuantity *physical;
 
   // Filled by initializer
-  FieldType *baseFieldTypePtr;
+  FieldType             *baseFieldTypePtr;
+  FieldPrintFunctionType pfMode[OUTPUT_MODE_COUNT]; // pf specialised per output mode
 };
 
 #ifdef FIELDTYPE_GLOBALS
@@ -0,0 +1,445 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Field value filters.
+ *
+ * Each -filter option adds an expression of the form
+ *
+ *   <pgn>.<field> <op> <value>             where <op> is one of < <= > >= = == !=
+ *   <pgn>.<field> between <low> and <high>
+ *   <pgn>.<field> in {<value>, <value>, ...}
+ *
+ * for instance "129026.SOG > 5" or "129038.User ID in {244050447, 244050448}". The field is
+ * named as printed, or as with -camel. The values are in the unit that analyzer prints the
+ * field in, so they depend on -si.
+ *
+ * When filters are given only messages of PGNs that have a filter are printed, and only when
+ * all filters for that PGN match. A field that is 'not available' does not match.
+ *
+ * The values are converted to raw integers once, using the resolution of the field, so
+ * a message is checked by extracting the raw value of the field and comparing integers,
+ * before anything is formatted.
+ */
+
+#include "analyzer.h"
+
+typedef enum FilterOp
+{
+  FILTER_RANGE,
+  FILTER_NOT_EQUAL,
+  FILTER_IN
+} FilterOp;
+
+typedef struct Filter
+{
+  struct Filter *next;
+  const Field   *field;
+  size_t         startBit;
+  FilterOp       op;
+  int64_t        low; // FILTER_RANGE: low <= raw <= high; FILTER_NOT_EQUAL: raw != low
+  int64_t        high;
+  size_t         count; // FILTER_IN
+  int64_t       *value;
+} Filter;
+
+static const char **filterExpressions;
+static size_t       filterExpressionCount;
+static Filter     **filters; // Indexed by position in pgnList, NULL if PGN has no filter
+
+extern void filterAdd(const char *expression)
+{
+  filterExpressions = realloc(filterExpressions, (filterExpressionCount + 1) * sizeof(char *));
+  if (filterExpressions == NULL)
+  {
+    die("Out of memory");
+  }
+  filterExpressions[filterExpressionCount++] = expression;
+}
+
+/*
+ * Convert a value in printed units to the raw value, which is returned as a double so the
+ * caller can decide how to round it.
+ */
+static double toRaw(const Field *field, double value)
+{
+  double resolution = (field->resolution != 0.0) ? field->resolution : 1.0;
+  double raw        = (value - field->unitOffset) / resolution;
+  double rounded    = round(raw);
+
+  // Values such as 0.3 / 0.1 are not exact; snap them to the integer that was meant
+  if (fabs(raw - rounded) < 1e-6)
+  {
+    raw = rounded;
+  }
+  return raw;
+}
+
+static int64_t clampToInt64(double d)
+{
+  if (d >= 9.2e18)
+  {
+    return INT64_MAX;
+  }
+  if (d <= -9.2e18)
+  {
+    return INT64_MIN;
+  }
+  return (int64_t) d;
+}
+
+static bool parseValue(const char **p, double *value)
+{
+  char *end;
+
+  *value = strtod(*p, &end);
+  if (end == *p)
+  {
+    return false;
+  }
+  *p = end;
+  while (isspace((unsigned char) **p))
+  {
+    (*p)++;
+  }
+  return true;
+}
+
+static bool startsWithWord(const char *p, const char *word)
+{
+  size_t len = strlen(word);
+
+  return strncmp(p, word, len) == 0 && isspace((unsigned char) p[len]);
+}
+
+/*
+ * Parse the operator and the value(s) of an expression into <filter>, for a field.
+ */
+static bool parseCondition(const char *p, const Field *field, Filter *filter)
+{
+  double a;
+  double b;
+
+  filter->op   = FILTER_RANGE;
+  filter->low  = INT64_MIN;
+  filter->high = INT64_MAX;
+
+  if (startsWithWord(p, "between"))
+  {
+    p += strlen("between");
+    while (isspace((unsigned char) *p))
+    {
+      p++;
+    }
+    if (!parseValue(&p, &a) || !startsWithWord(p, "and"))
+    {
+      return false;
+    }
+    p += strlen("and");
+    if (!parseValue(&p, &b) || *p != '\0')
+    {
+      return false;
+    }
+    filter->low  = clampToInt64(ceil(toRaw(field, a)));
+    filter->high = clampToInt64(floor(toRaw(field, b)));
+    return true;
+  }
+
+  if (startsWithWord(p, "in"))
+  {
+    p += strlen("in");
+    while (isspace((unsigned char) *p))
+    {
+      p++;
+    }
+    if (*p++ != '{')
+    {
+      return false;
+    }
+    filter->op = FILTER_IN;
+    for (;;)
+    {
+      while (isspace((unsigned char) *p) || *p == ',')
+      {
+        p++;
+      }
+      if (*p == '}')
+      {
+        break;
+      }
+      if (!parseValue(&p, &a))
+      {
+        return false;
+      }
+      filter->value = realloc(filter->value, (filter->count + 1) * sizeof(int64_t));
+      if (filter->value == NULL)
+      {
+        die("Out of memory");
+      }
+      filter->value[filter->count++] = clampToInt64(round(toRaw(field, a)));
+    }
+    return p[1] == '\0';
+  }
+
+  if (strncmp(p, "<=", 2) == 0 || strncmp(p, ">=", 2) == 0 || strncmp(p, "==", 2) == 0 || strncmp(p, "!=", 2) == 0)
+  {
+    char op = p[0];
+
+    p += 2;
+    while (isspace((unsigned char) *p))
+    {
+      p++;
+    }
+    if (!parseValue(&p, &a) || *p != '\0')
+    {
+      return false;
+    }
+    a = toRaw(field, a);
+    switch (op)
+    {
+      case '<':
+        filter->high = clampToInt64(floor(a));
+        break;
+      case '>':
+        filter->low = clampToInt64(ceil(a));
+        break;
+      case '=':
+        filter->low  = clampToInt64(round(a));
+        filter->high = filter->low;
+        break;
+      default:
+        filter->op  = FILTER_NOT_EQUAL;
+        filter->low = clampToInt64(round(a));
+        break;
+    }
+    return true;
+  }
+
+  if (*p == '<' || *p == '>' || *p == '=')
+  {
+    char op = *p++;
+
+    while (isspace((unsigned char) *p))
+    {
+      p++;
+    }
+    if (!parseValue(&p, &a) || *p != '\0')
+    {
+      return false;
+    }
+    a = toRaw(field, a);
+    switch (op)
+    {
+      case '<':
+        filter->high = clampToInt64(ceil(a)) - 1;
+        break;
+      case '>':
+        filter->low = clampToInt64(floor(a)) + 1;
+        break;
+      default:
+        filter->low  = clampToInt64(round(a));
+        filter->high = filter->low;
+        break;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Return the start of the operator in <expression>, which ends the field name.
+ */
+static const char *findOperator(const char *p)
+{
+  for (; *p != '\0'; p++)
+  {
+    if (*p == '<' || *p == '>' || *p == '=' || (*p == '!' && p[1] == '='))
+    {
+      return p;
+    }
+    if (isspace((unsigned char) *p) && (startsWithWord(p + 1, "between") || startsWithWord(p + 1, "in")))
+    {
+      return p + 1;
+    }
+  }
+  return NULL;
+}
+
+static void compileFilter(const char *expression)
+{
+  unsigned long prn;
+  char         *end;
+  const char   *op;
+  char          name[80];
+  size_t        len;
+  bool          found = false;
+
+  prn = strtoul(expression, &end, 10);
+  op  = findOperator(end);
+  if (end == expression || *end != '.' || op == NULL)
+  {
+    logAbort("Invalid filter '%s'; expected '<pgn>.<field> <op> <value>'\n", expression);
+  }
+  for (len = op - (end + 1); len > 0 && isspace((unsigned char) end[len]); len--)
+    ;
+  if (len == 0 || len >= sizeof(name))
+  {
+    logAbort("Invalid filter '%s'; expected '<pgn>.<field> <op> <value>'\n", expression);
+  }
+  memcpy(name, end + 1, len);
+  name[len] = '\0';
+
+  // There can be multiple definitions for the same PGN (proprietary variants)
+  for (size_t i = 0; i < pgnListSize; i++)
+  {
+    Pgn *pgn = &pgnList[i];
+
+    if (pgn->pgn != prn || pgn->fallback)
+    {
+      continue;
+    }
+    for (size_t j = 0; j < pgn->fieldCount; j++)
+    {
+      const Field *field = &pgn->fieldList[j];
+      Filter      *filter;
+
+      if (!fieldNameMatches(field, name))
+      {
+        continue;
+      }
+      filter = calloc(1, sizeof(Filter));
+      if (filter == NULL)
+      {
+        die("Out of memory");
+      }
+      if (!isNumericField(field) || !getFixedStartBit(pgn, field, &filter->startBit))
+      {
+        logAbort("Invalid filter '%s'; field '%s' of PGN %lu is not a numeric field at a fixed position\n",
+                 expression,
+                 field->name,
+                 prn);
+      }
+      if (!parseCondition(op, field, filter))
+      {
+        logAbort("Invalid filter '%s'; cannot parse the condition '%s'\n", expression, op);
+      }
+      filter->field = field;
+      filter->next  = filters[i];
+      filters[i]    = filter;
+      found         = true;
+      logDebug("Filter PGN %lu field '%s' op %d raw %" PRId64 "..%" PRId64 " count %zu\n",
+               prn,
+               field->name,
+               filter->op,
+               filter->low,
+               filter->high,
+               filter->count);
+      break;
+    }
+  }
+  if (!found)
+  {
+    logAbort("Invalid filter '%s'; PGN %lu has no field '%s'\n", expression, prn, name);
+  }
+}
+
+/*
+ * Convert the filter expressions to raw value checks. Called once the field types are known.
+ */
+extern void filterInit(void)
+{
+  if (filterExpressionCount == 0)
+  {
+    return;
+  }
+  filters = calloc(pgnListSize, sizeof(Filter *));
+  if (filters == NULL)
+  {
+    die("Out of memory");
+  }
+  for (size_t i = 0; i < filterExpressionCount; i++)
+  {
+    compileFilter(filterExpressions[i]);
+  }
+}
+
+static bool filterMatches(const Filter *filter, uint8_t *data, size_t length)
+{
+  int64_t value;
+  int64_t maxValue;
+  int64_t reserved;
+
+  if (!extractNumber(filter->field, data, length, filter->startBit, filter->field->size, &value, &maxValue))
+  {
+    return false;
+  }
+  reserved = (maxValue >= 7) ? 2 : (maxValue > 1) ? 1 : 0;
+  if (value > maxValue - reserved)
+  {
+    return false;
+  }
+
+  switch (filter->op)
+  {
+    case FILTER_RANGE:
+      return value >= filter->low && value <= filter->high;
+    case FILTER_NOT_EQUAL:
+      return value != filter->low;
+    case FILTER_IN:
+      for (size_t i = 0; i < filter->count; i++)
+      {
+        if (value == filter->value[i])
+        {
+          return true;
+        }
+      }
+      return false;
+  }
+  return false;
+}
+
+/*
+ * Return true when the message should be printed.
+ */
+extern bool filterPass(const Pgn *pgn, uint8_t *data, size_t length)
+{
+  const Filter *filter;
+
+  if (filters == NULL)
+  {
+    return true;
+  }
+  filter = filters[pgn - pgnList];
+  if (filter == NULL)
+  {
+    return false;
+  }
+  for (; filter != NULL; filter = filter->next)
+  {
+    if (!filterMatches(filter, data, length))
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,217 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Follow mode.
+ *
+ * With -follow the -file log is read like `tail -F` does: at the end of the file analyzer
+ * waits for more data instead of stopping. When the file is truncated it is read again from
+ * the start, and when it is rotated (the name now refers to a new file) the rest of the old
+ * file is read before the new one is opened. The decoder state, such as partly reassembled
+ * fast packets, is kept across both.
+ *
+ * On Linux the wait uses inotify on the file and its directory, so new data is seen as soon
+ * as it is written. Elsewhere the file is checked every FOLLOW_POLL_MS milliseconds.
+ */
+
+#include "analyzer.h"
+
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define FOLLOW_POLL_MS (10)
+#define FOLLOW_CHECK_MS (1000) // Look at the file anyway when no event arrives
+
+static const char *followName;
+static bool        follow;
+static int         notifyFd  = -1;
+static int         fileWatch = -1;
+static int         dirWatch  = -1;
+static size_t      partialLen; // Part of a line that was read before the end of the file
+
+extern void followSetEnabled(void)
+{
+  follow = true;
+}
+
+extern bool followEnabled(void)
+{
+  return follow;
+}
+
+static void watchFile(void)
+{
+#ifdef __linux__
+  if (fileWatch >= 0)
+  {
+    inotify_rm_watch(notifyFd, fileWatch);
+  }
+  fileWatch = inotify_add_watch(notifyFd, followName, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+}
+
+extern void followOpen(const char *name)
+{
+  if (!follow)
+  {
+    return;
+  }
+  if (name == NULL)
+  {
+    logAbort("-follow needs -file\n");
+  }
+  followName = name;
+
+#ifdef __linux__
+  {
+    char  dir[1024];
+    char *slash;
+
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd < 0)
+    {
+      logAbort("Cannot use inotify: %s\n", strerror(errno));
+    }
+    watchFile();
+
+    // The directory tells when a new file is created under the name
+    snprintf(dir, sizeof(dir), "%s", name);
+    slash = strrchr(dir, '/');
+    if (slash == NULL)
+    {
+      strcpy(dir, ".");
+    }
+    else if (slash == dir)
+    {
+      slash[1] = '\0';
+    }
+    else
+    {
+      *slash = '\0';
+    }
+    dirWatch = inotify_add_watch(notifyFd, dir, IN_CREATE | IN_MOVED_TO);
+    if (fileWatch < 0 || dirWatch < 0)
+    {
+      logAbort("Cannot watch '%s': %s\n", name, strerror(errno));
+    }
+  }
+#endif
+}
+
+static void waitForChange(void)
+{
+#ifdef __linux__
+  struct pollfd pfd;
+  char          events[4096];
+
+  pfd.fd     = notifyFd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, FOLLOW_CHECK_MS) > 0)
+  {
+    while (read(notifyFd, events, sizeof(events)) > 0)
+    {
+      // Only the wake up matters, the file is looked at by the caller
+    }
+  }
+#else
+  poll(NULL, 0, FOLLOW_POLL_MS);
+#endif
+}
+
+/*
+ * Wait until there is more to read. Returns false when the file was truncated or replaced,
+ * so a partly read line must be dropped.
+ */
+static bool waitForData(FILE *file)
+{
+  for (;;)
+  {
+    struct stat st;
+    struct stat named;
+    off_t       position = ftello(file);
+
+    if (fstat(fileno(file), &st) != 0)
+    {
+      logAbort("Cannot stat '%s': %s\n", followName, strerror(errno));
+    }
+    if (st.st_size > position)
+    {
+      return true;
+    }
+    if (st.st_size < position)
+    {
+      logInfo("%s was truncated, reading it from the start\n", followName);
+      if (fseeko(file, 0, SEEK_SET) != 0)
+      {
+        logAbort("Cannot seek in '%s': %s\n", followName, strerror(errno));
+      }
+      return false;
+    }
+    if (stat(followName, &named) == 0 && (named.st_ino != st.st_ino || named.st_dev != st.st_dev))
+    {
+      // The writer may still add to the old file until it opens the new one
+      if (fstat(fileno(file), &st) == 0 && st.st_size > position)
+      {
+        return true;
+      }
+      logInfo("%s was replaced, reading the new file\n", followName);
+      if (freopen(followName, "r", file) == NULL)
+      {
+        logAbort("Cannot open '%s': %s\n", followName, strerror(errno));
+      }
+      watchFile();
+      return false;
+    }
+    waitForChange();
+  }
+}
+
+/*
+ * Read the next line of the log, like fgets(), waiting for it at the end of the file.
+ */
+extern char *followReadLine(char *line, int size, FILE *file)
+{
+  for (;;)
+  {
+    if (fgets(line + partialLen, size - partialLen, file) != NULL)
+    {
+      partialLen += strlen(line + partialLen);
+      if (line[partialLen - 1] == '\n' || partialLen == (size_t) size - 1)
+      {
+        partialLen = 0;
+        return line;
+      }
+      // The writer has not finished this line yet
+    }
+    if (ferror(file))
+    {
+      logAbort("Cannot read '%s': %s\n", followName, strerror(errno));
+    }
+    clearerr(file);
+    if (!waitForData(file))
+    {
+      partialLen = 0;
+    }
+  }
+}
@@ -0,0 +1,581 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Compressed input.
+ *
+ * The input is recognised as gzip or zstd compressed by its magic bytes and decompressed
+ * in-process. Support is a build option: `make ZLIB=1` links the system zlib and
+ * `make ZSTD=1` the system libzstd.
+ *
+ * The decompression runs on its own thread that fills a ring of INPUT_BUFFER_COUNT buffers
+ * of INPUT_BUFFER_SIZE bytes, so that decompressing the next part of the log overlaps with
+ * decoding the lines of the current one. Uncompressed input is read with stdio as before, or
+ * through follow.c with -follow. Each log that is merged with -file has its own reader, with
+ * its own thread and decompression state.
+ *
+ * Logging is not thread safe, so the thread does not log. It keeps the first error that it
+ * runs into and ends the input; the main thread logs the error when it reaches the end.
+ */
+
+#include <pthread.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "analyzer.h"
+
+#define INPUT_BUFFER_SIZE (1024 * 1024)
+#define INPUT_BUFFER_COUNT (4)
+#define INPUT_READ_SIZE (256 * 1024)
+
+typedef enum InputType
+{
+  INPUT_PLAIN,
+  INPUT_GZIP,
+  INPUT_ZSTD
+} InputType;
+
+typedef struct InputBuffer
+{
+  char  *data;
+  size_t len; // 0 marks the end of the input
+} InputBuffer;
+
+struct InputReader
+{
+  FILE     *file;
+  InputType type;
+  bool      threaded;
+  pthread_t thread;
+  uint8_t   prefix[4]; // Bytes read to find the magic, decompressed first
+  size_t    prefixLen;
+
+  InputBuffer     ring[INPUT_BUFFER_COUNT];
+  size_t          ringHead; // Next buffer to fill
+  size_t          ringTail; // Next buffer to read
+  size_t          ringFull; // Number of filled buffers
+  pthread_mutex_t ringLock;
+  pthread_cond_t  ringCond;
+
+  InputBuffer *current; // Buffer that lines are read from, or NULL
+  size_t       currentPos;
+  bool         end;
+  bool         stopping; // Reading stopped before the end of the input
+
+  char error[256]; // First error of the thread, logged when the end of the input is read
+  bool errorFatal;
+};
+
+static const uint8_t zstdMagic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+
+static InputReader *mainReader; // Reader of the input that is not merged
+
+static void inputFail(InputReader *in, bool fatal, const char *format, ...)
+{
+  va_list ap;
+
+  if (in->error[0] != '\0')
+  {
+    return;
+  }
+  va_start(ap, format);
+  vsnprintf(in->error, sizeof(in->error), format, ap);
+  va_end(ap);
+  in->errorFatal = fatal;
+}
+
+/*
+ * Read compressed data, starting with the bytes that were read to find the magic.
+ */
+static size_t readRaw(InputReader *in, uint8_t *data, size_t size)
+{
+  size_t n = 0;
+
+  if (in->prefixLen > 0)
+  {
+    n = min(size, in->prefixLen);
+    memcpy(data, in->prefix, n);
+    memmove(in->prefix, in->prefix + n, in->prefixLen - n);
+    in->prefixLen -= n;
+    return n;
+  }
+  n = fread(data, 1, size, in->file);
+  if (n == 0 && ferror(in->file))
+  {
+    inputFail(in, true, "Cannot read input: %s\n", strerror(errno));
+  }
+  return n;
+}
+
+/*
+ * Get the next buffer to fill, or NULL when the reader has stopped.
+ */
+static InputBuffer *fillStart(InputReader *in)
+{
+  InputBuffer *b = NULL;
+
+  pthread_mutex_lock(&in->ringLock);
+  while (in->ringFull == INPUT_BUFFER_COUNT && !in->stopping)
+  {
+    pthread_cond_wait(&in->ringCond, &in->ringLock);
+  }
+  if (!in->stopping)
+  {
+    b = &in->ring[in->ringHead];
+  }
+  pthread_mutex_unlock(&in->ringLock);
+  return b;
+}
+
+static void fillDone(InputReader *in, size_t len)
+{
+  pthread_mutex_lock(&in->ringLock);
+  in->ring[in->ringHead].len = len;
+  in->ringHead               = (in->ringHead + 1) % INPUT_BUFFER_COUNT;
+  in->ringFull++;
+  pthread_cond_signal(&in->ringCond);
+  pthread_mutex_unlock(&in->ringLock);
+}
+
+static InputBuffer *readStart(InputReader *in)
+{
+  InputBuffer *b;
+
+  pthread_mutex_lock(&in->ringLock);
+  while (in->ringFull == 0)
+  {
+    pthread_cond_wait(&in->ringCond, &in->ringLock);
+  }
+  b = &in->ring[in->ringTail];
+  pthread_mutex_unlock(&in->ringLock);
+  return b;
+}
+
+static void readDone(InputReader *in)
+{
+  pthread_mutex_lock(&in->ringLock);
+  in->ringTail = (in->ringTail + 1) % INPUT_BUFFER_COUNT;
+  in->ringFull--;
+  pthread_cond_signal(&in->ringCond);
+  pthread_mutex_unlock(&in->ringLock);
+}
+
+static void plainCopy(InputReader *in)
+{
+  for (;;)
+  {
+    InputBuffer *b = fillStart(in);
+    size_t       len;
+
+    if (b == NULL)
+    {
+      return;
+    }
+    // A short read is not the end of a pipe, so fill the buffer until EOF
+    for (len = 0; len < INPUT_BUFFER_SIZE;)
+    {
+      size_t n = readRaw(in, (uint8_t *) b->data + len, INPUT_BUFFER_SIZE - len);
+
+      if (n == 0)
+      {
+        break;
+      }
+      len += n;
+    }
+    if (len == 0)
+    {
+      return;
+    }
+    fillDone(in, len);
+  }
+}
+
+#ifdef HAVE_ZLIB
+static void gzipDecompress(InputReader *in)
+{
+  z_stream zs;
+  uint8_t *raw     = malloc(INPUT_READ_SIZE);
+  bool     rawEnd  = false;
+  bool     stopped = false;
+
+  if (raw == NULL)
+  {
+    inputFail(in, true, "Out of memory\n");
+    return;
+  }
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 15 + 16) != Z_OK) // 15 bits window, gzip header
+  {
+    inputFail(in, true, "Cannot initialize zlib\n");
+    free(raw);
+    return;
+  }
+
+  while (in->error[0] == '\0')
+  {
+    InputBuffer *b = fillStart(in);
+
+    if (b == NULL)
+    {
+      stopped = true;
+      break;
+    }
+    zs.next_out  = (Bytef *) b->data;
+    zs.avail_out = INPUT_BUFFER_SIZE;
+    while (zs.avail_out > 0)
+    {
+      uInt before = zs.avail_out;
+      int  ret;
+
+      if (zs.avail_in == 0 && !rawEnd)
+      {
+        zs.next_in  = raw;
+        zs.avail_in = readRaw(in, raw, INPUT_READ_SIZE);
+        rawEnd      = (zs.avail_in == 0);
+      }
+      ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      {
+        inflateReset(&zs); // Files can hold several concatenated gzip members
+      }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+      {
+        inputFail(in, true, "Cannot decompress gzip input: %s\n", zs.msg ? zs.msg : "invalid data");
+        break;
+      }
+      if (in->error[0] != '\0' || (rawEnd && zs.avail_in == 0 && zs.avail_out == before))
+      {
+        break;
+      }
+    }
+    if (zs.avail_out == INPUT_BUFFER_SIZE)
+    {
+      break;
+    }
+    fillDone(in, INPUT_BUFFER_SIZE - zs.avail_out);
+  }
+  if (zs.total_in > 0 && !stopped)
+  {
+    inputFail(in, false, "gzip input is truncated\n");
+  }
+  inflateEnd(&zs);
+  free(raw);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void zstdDecompress(InputReader *in)
+{
+  ZSTD_DStream *zds     = ZSTD_createDStream();
+  uint8_t      *raw     = malloc(INPUT_READ_SIZE);
+  ZSTD_inBuffer zin     = {raw, 0, 0};
+  size_t        pending = 0; // Non zero while in the middle of a frame
+  bool          rawEnd  = false;
+  bool          stopped = false;
+
+  if (zds == NULL || raw == NULL)
+  {
+    inputFail(in, true, "Out of memory\n");
+    ZSTD_freeDStream(zds);
+    free(raw);
+    return;
+  }
+  ZSTD_initDStream(zds);
+
+  while (in->error[0] == '\0')
+  {
+    InputBuffer   *b = fillStart(in);
+    ZSTD_outBuffer zout;
+
+    if (b == NULL)
+    {
+      stopped = true;
+      break;
+    }
+    zout.dst  = b->data;
+    zout.size = INPUT_BUFFER_SIZE;
+    zout.pos  = 0;
+    while (zout.pos < zout.size)
+    {
+      size_t inBefore  = zin.pos;
+      size_t outBefore = zout.pos;
+      size_t ret;
+
+      if (zin.pos == zin.size && !rawEnd)
+      {
+        zin.size = readRaw(in, raw, INPUT_READ_SIZE);
+        zin.pos  = 0;
+        inBefore = 0;
+        rawEnd   = (zin.size == 0);
+      }
+      ret = ZSTD_decompressStream(zds, &zout, &zin);
+      if (ZSTD_isError(ret))
+      {
+        inputFail(in, true, "Cannot decompress zstd input: %s\n", ZSTD_getErrorName(ret));
+        break;
+      }
+      if (zin.pos != inBefore || zout.pos != outBefore)
+      {
+        pending = ret;
+      }
+      else if (rawEnd || in->error[0] != '\0')
+      {
+        break;
+      }
+    }
+    if (zout.pos == 0)
+    {
+      break;
+    }
+    fillDone(in, zout.pos);
+  }
+  if (pending != 0 && !stopped)
+  {
+    inputFail(in, false, "zstd input is truncated\n");
+  }
+  ZSTD_freeDStream(zds);
+  free(raw);
+}
+#endif
+
+static void *inputThread(void *arg)
+{
+  InputReader *in = arg;
+
+  switch (in->type)
+  {
+#ifdef HAVE_ZLIB
+    case INPUT_GZIP:
+      gzipDecompress(in);
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case INPUT_ZSTD:
+      zstdDecompress(in);
+      break;
+#endif
+    default:
+      plainCopy(in);
+      break;
+  }
+  if (fillStart(in) != NULL)
+  {
+    fillDone(in, 0);
+  }
+  return NULL;
+}
+
+/*
+ * Create a reader for a file. The first bytes of the file are used to see whether it is
+ * compressed, and if so a thread is started that decompresses it, in which case the file
+ * cannot be seeked.
+ */
+extern InputReader *inputReaderOpen(FILE *file)
+{
+  InputReader *in    = calloc(1, sizeof(InputReader));
+  off_t        start = ftello(file);
+  int          c     = getc(file);
+
+  if (in == NULL)
+  {
+    die("Out of memory");
+  }
+  in->file = file;
+  if (c != zstdMagic[0] && c != 0x1f)
+  {
+    if (c != EOF)
+    {
+      ungetc(c, file);
+    }
+    return in;
+  }
+
+  in->prefix[0] = (uint8_t) c;
+  in->prefixLen = 1 + fread(in->prefix + 1, 1, sizeof(in->prefix) - 1, file);
+  if (in->prefixLen >= 2 && in->prefix[0] == 0x1f && in->prefix[1] == 0x8b)
+  {
+#ifndef HAVE_ZLIB
+    logAbort("Input is gzip compressed, but analyzer was built without zlib; build it with 'make ZLIB=1'\n");
+#endif
+    in->type = INPUT_GZIP;
+  }
+  else if (in->prefixLen == sizeof(zstdMagic) && memcmp(in->prefix, zstdMagic, sizeof(zstdMagic)) == 0)
+  {
+#ifndef HAVE_ZSTD
+    logAbort("Input is zstd compressed, but analyzer was built without libzstd; build it with 'make ZSTD=1'\n");
+#endif
+    in->type = INPUT_ZSTD;
+  }
+  else if (start >= 0 && fseeko(file, start, SEEK_SET) == 0)
+  {
+    in->prefixLen = 0;
+    return in;
+  }
+  else
+  {
+    in->type = INPUT_PLAIN; // Not compressed after all, but the bytes cannot be put back
+  }
+
+  for (size_t i = 0; i < INPUT_BUFFER_COUNT; i++)
+  {
+    in->ring[i].data = malloc(INPUT_BUFFER_SIZE);
+    if (in->ring[i].data == NULL)
+    {
+      die("Out of memory");
+    }
+  }
+  pthread_mutex_init(&in->ringLock, NULL);
+  pthread_cond_init(&in->ringCond, NULL);
+  if (pthread_create(&in->thread, NULL, inputThread, in) != 0)
+  {
+    logAbort("Cannot start input thread: %s\n", strerror(errno));
+  }
+  in->threaded = true;
+  logDebug("Reading %s input\n", in->type == INPUT_GZIP ? "gzip" : in->type == INPUT_ZSTD ? "zstd" : "plain");
+  return in;
+}
+
+/*
+ * Read the next line of a reader, like fgets().
+ */
+extern char *inputReaderReadLine(InputReader *in, char *line, int size)
+{
+  int n = 0;
+
+  if (!in->threaded)
+  {
+    return fgets(line, size, in->file);
+  }
+
+  while (n < size - 1 && !in->end)
+  {
+    const char *data;
+    const char *nl;
+    size_t      len;
+
+    if (in->current == NULL)
+    {
+      in->current    = readStart(in);
+      in->currentPos = 0;
+      if (in->current->len == 0)
+      {
+        in->end = true;
+        if (in->error[0] != '\0')
+        {
+          if (in->errorFatal)
+          {
+            logAbort("%s", in->error);
+          }
+          logError("%s", in->error);
+        }
+        break;
+      }
+    }
+
+    data = in->current->data + in->currentPos;
+    len  = min(in->current->len - in->currentPos, (size_t) (size - 1 - n));
+    nl   = memchr(data, '\n', len);
+    if (nl != NULL)
+    {
+      len = nl - data + 1;
+    }
+    memcpy(line + n, data, len);
+    n += len;
+    in->currentPos += len;
+    if (in->currentPos == in->current->len)
+    {
+      in->current = NULL;
+      readDone(in);
+    }
+    if (nl != NULL)
+    {
+      break;
+    }
+  }
+
+  if (n == 0)
+  {
+    return NULL;
+  }
+  line[n] = '\0';
+  return line;
+}
+
+/*
+ * Stop the thread of a reader and free it. The file is not closed.
+ */
+extern void inputReaderClose(InputReader *in)
+{
+  if (in == NULL)
+  {
+    return;
+  }
+  if (in->threaded)
+  {
+    // The thread may be waiting for a free buffer when reading stopped early
+    pthread_mutex_lock(&in->ringLock);
+    in->stopping = !in->end;
+    pthread_cond_signal(&in->ringCond);
+    pthread_mutex_unlock(&in->ringLock);
+    pthread_join(in->thread, NULL);
+    for (size_t i = 0; i < INPUT_BUFFER_COUNT; i++)
+    {
+      free(in->ring[i].data);
+    }
+    pthread_mutex_destroy(&in->ringLock);
+    pthread_cond_destroy(&in->ringCond);
+  }
+  free(in);
+}
+
+/*
+ * Open the input that is not merged. Returns true when it is read through a thread, in which
+ * case it cannot be seeked.
+ */
+extern bool inputOpen(FILE *file)
+{
+  mainReader = inputReaderOpen(file);
+  return mainReader->threaded;
+}
+
+/*
+ * Read the next line of the input that is not merged, like fgets().
+ */
+extern char *inputReadLine(char *line, int size, FILE *file)
+{
+  if (mainReader == NULL || !mainReader->threaded)
+  {
+    return followEnabled() ? followReadLine(line, size, file) : fgets(line, size, file);
+  }
+  return inputReaderReadLine(mainReader, line, size);
+}
+
+extern void inputClose(void)
+{
+  inputReaderClose(mainReader);
+  mainReader = NULL;
+}
@@ -0,0 +1,354 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * SID join.
+ *
+ * The SID (sequence identifier) field ties related PGNs from the same source together,
+ * for instance 128259 speed and 128267 depth from the same sample, or 129029, 129539 and
+ * 129540 from the same GNSS fix. With -join <pgn>,<pgn>[,...] messages of the member PGNs
+ * are formatted as usual but held back per (source, SID). Once all members have arrived
+ * they are printed as one record; in JSON mode as
+ *
+ *   {"timestamp":"...","src":1,"sid":23,"join":[{<member 1>},{<member 2>}]}
+ *
+ * (with -camel "join" is an object with the members under their description) and in text mode as the member lines joined by " | ".
+ *
+ * A join that is not complete within the -join-window (based on the message timestamps),
+ * or that receives a second message of the same member PGN, is printed with the members
+ * it has. At most JOIN_SLOTS joins are open at the same time; when more are needed the
+ * oldest one is printed.
+ *
+ * Messages whose SID is 'not available' are printed as usual.
+ */
+
+#include "analyzer.h"
+
+#define JOIN_MAX_MEMBERS (8)
+#define JOIN_SLOTS (64)
+#define JOIN_DEFAULT_WINDOW (1000) // Milliseconds
+
+typedef struct JoinGroup
+{
+  size_t   count;
+  uint32_t pgn[JOIN_MAX_MEMBERS];
+} JoinGroup;
+
+typedef struct JoinSlot
+{
+  bool       used;
+  uint64_t   created; // Sequence number, to find the oldest open slot
+  JoinGroup *group;
+  uint8_t    src;
+  uint8_t    sid;
+  bool       haveTime;
+  uint64_t   time; // Timestamp of the first member, in milliseconds
+  char       timestamp[DATE_LENGTH];
+  uint32_t   members; // Bit mask of the members that have arrived
+  char      *text[JOIN_MAX_MEMBERS];
+  size_t     len[JOIN_MAX_MEMBERS];
+  size_t     alloc[JOIN_MAX_MEMBERS];
+} JoinSlot;
+
+static JoinGroup *joinGroups;
+static size_t     joinGroupCount;
+static uint64_t   joinWindow = JOIN_DEFAULT_WINDOW;
+static JoinSlot   joinSlots[JOIN_SLOTS];
+static size_t     joinSlotsUsed;
+static uint64_t   joinSequence;
+
+static JoinSlot *capture; // Slot that the message being formatted is stored in
+static size_t    captureMember;
+
+extern void joinAddGroup(const char *pgns)
+{
+  JoinGroup  *group;
+  const char *p = pgns;
+  char       *end;
+
+  joinGroups = realloc(joinGroups, (joinGroupCount + 1) * sizeof(JoinGroup));
+  if (joinGroups == NULL)
+  {
+    die("Out of memory");
+  }
+  group        = &joinGroups[joinGroupCount++];
+  group->count = 0;
+
+  while (*p != '\0')
+  {
+    unsigned long prn = strtoul(p, &end, 10);
+
+    if (end == p || (*end != ',' && *end != '\0') || group->count == JOIN_MAX_MEMBERS || searchForPgn(prn) == NULL)
+    {
+      logAbort("Invalid -join '%s'; expected up to %d known PGNs separated by commas\n", pgns, JOIN_MAX_MEMBERS);
+    }
+    for (size_t i = 0; i < joinGroupCount; i++)
+    {
+      for (size_t j = 0; j < joinGroups[i].count; j++)
+      {
+        if (joinGroups[i].pgn[j] == prn)
+        {
+          logAbort("PGN %lu is in more than one -join\n", prn);
+        }
+      }
+    }
+    group->pgn[group->count++] = prn;
+    p                          = (*end == ',') ? end + 1 : end;
+  }
+  if (group->count < 2)
+  {
+    logAbort("Invalid -join '%s'; a join needs at least two PGNs\n", pgns);
+  }
+}
+
+extern bool joinEnabled(void)
+{
+  return joinGroupCount > 0;
+}
+
+extern void joinSetWindow(const char *window)
+{
+  if (!parseDuration(window, &joinWindow))
+  {
+    logAbort("Invalid join window '%s'\n", window);
+  }
+}
+
+static bool findMember(uint32_t pgn, JoinGroup **group, size_t *member)
+{
+  for (size_t i = 0; i < joinGroupCount; i++)
+  {
+    for (size_t j = 0; j < joinGroups[i].count; j++)
+    {
+      if (joinGroups[i].pgn[j] == pgn)
+      {
+        *group  = &joinGroups[i];
+        *member = j;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void releaseSlot(JoinSlot *slot)
+{
+  slot->used    = false;
+  slot->members = 0;
+  joinSlotsUsed--;
+}
+
+/*
+ * Print the members that a slot has collected and release it. A slot without members, whose
+ * only message could not be formatted, is released without printing.
+ */
+static void printSlot(JoinSlot *slot)
+{
+  const char *s     = "";
+  bool        keyed = pgnList[0].camelDescription != NULL; // With -camel each member starts with its key
+
+  if (slot->members == 0)
+  {
+    releaseSlot(slot);
+    return;
+  }
+  if (showJson)
+  {
+    mprintf("{\"timestamp\":\"%s\",\"src\":%u,\"sid\":%u,\"join\":%s", slot->timestamp, slot->src, slot->sid, keyed ? "{" : "[");
+  }
+  for (size_t i = 0; i < slot->group->count; i++)
+  {
+    if ((slot->members & (1u << i)) != 0)
+    {
+      mprintf("%s", s);
+      mappend(slot->text[i], slot->len[i]);
+      s = showJson ? "," : " | ";
+    }
+  }
+  mprintf(showJson ? (keyed ? "}}\n" : "]}\n") : "\n");
+  mwrite(stdout);
+  releaseSlot(slot);
+}
+
+static JoinSlot *oldestSlot(void)
+{
+  JoinSlot *oldest = NULL;
+
+  for (size_t i = 0; i < JOIN_SLOTS; i++)
+  {
+    if (joinSlots[i].used && (oldest == NULL || joinSlots[i].created < oldest->created))
+    {
+      oldest = &joinSlots[i];
+    }
+  }
+  return oldest;
+}
+
+static void expireSlots(uint64_t now)
+{
+  JoinSlot *slot;
+
+  while (joinSlotsUsed > 0 && (slot = oldestSlot()) != NULL && slot->haveTime && now >= slot->time + joinWindow)
+  {
+    printSlot(slot);
+  }
+}
+
+/*
+ * Called by printPgn() before the message is formatted. When the message belongs to a join
+ * it is formatted as usual, and joinCapture() stores the result instead of printing it.
+ */
+extern void joinCollect(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length)
+{
+  JoinGroup *group;
+  JoinSlot  *slot = NULL;
+  size_t     member;
+  size_t     startBit;
+  int64_t    sid;
+  int64_t    maxValue;
+  uint64_t   now;
+  bool       haveTime;
+
+  capture = NULL;
+  if (joinGroupCount == 0)
+  {
+    return;
+  }
+
+  haveTime = parseTimestamp(msg->timestamp, &now);
+  if (haveTime)
+  {
+    expireSlots(now);
+  }
+
+  if (!findMember(msg->pgn, &group, &member) || pgn->fieldCount == 0 || strcmp(pgn->fieldList[0].name, "SID") != 0
+      || !getFixedStartBit(pgn, &pgn->fieldList[0], &startBit)
+      || !extractNumber(&pgn->fieldList[0], data, length, startBit, pgn->fieldList[0].size, &sid, &maxValue)
+      || sid > maxValue - 2)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < JOIN_SLOTS; i++)
+  {
+    if (joinSlots[i].used && joinSlots[i].group == group && joinSlots[i].src == msg->src && joinSlots[i].sid == sid)
+    {
+      slot = &joinSlots[i];
+      break;
+    }
+  }
+  if (slot != NULL && (slot->members & (1u << member)) != 0)
+  {
+    printSlot(slot);
+    slot = NULL;
+  }
+  if (slot == NULL)
+  {
+    if (joinSlotsUsed == JOIN_SLOTS)
+    {
+      printSlot(oldestSlot());
+    }
+    for (slot = joinSlots; slot->used; slot++)
+      ;
+    slot->used     = true;
+    slot->created  = joinSequence++;
+    slot->group    = group;
+    slot->src      = msg->src;
+    slot->sid      = (uint8_t) sid;
+    slot->haveTime = haveTime;
+    slot->time     = haveTime ? now : 0;
+    slot->members  = 0;
+    strcpy(slot->timestamp, msg->timestamp);
+    joinSlotsUsed++;
+  }
+
+  capture       = slot;
+  captureMember = member;
+}
+
+/*
+ * Called by printPgn() when the message has been formatted. Returns true when the message
+ * is part of a join and has been taken from the output buffer.
+ */
+extern bool joinCapture(void)
+{
+  JoinSlot *slot = capture;
+  size_t    len  = mlocation();
+
+  if (slot == NULL)
+  {
+    return false;
+  }
+  capture = NULL;
+
+  if (len > 0 && mchr(len - 1) == '\n')
+  {
+    len--;
+  }
+  if (slot->alloc[captureMember] < len)
+  {
+    slot->text[captureMember] = realloc(slot->text[captureMember], len);
+    if (slot->text[captureMember] == NULL)
+    {
+      die("Out of memory");
+    }
+    slot->alloc[captureMember] = len;
+  }
+  memcpy(slot->text[captureMember], mpointer(0), len);
+  slot->len[captureMember] = len;
+  slot->members |= 1u << captureMember;
+  mreset();
+
+  if (slot->members == (1u << slot->group->count) - 1)
+  {
+    printSlot(slot);
+  }
+  return true;
+}
+
+/*
+ * Called by printPgn() when the message could not be formatted. The slot that was taken for
+ * it is released again when it has no other members.
+ */
+extern void joinDiscard(void)
+{
+  JoinSlot *slot = capture;
+
+  capture = NULL;
+  if (slot != NULL && slot->members == 0)
+  {
+    releaseSlot(slot);
+  }
+}
+
+/*
+ * Print all open joins, oldest first.
+ */
+extern void joinFlush(void)
+{
+  JoinSlot *slot;
+
+  while ((slot = oldestSlot()) != NULL)
+  {
+    printSlot(slot);
+  }
+}
@@ -0,0 +1,196 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Merging of several input logs.
+ *
+ * When -file is given more than once the logs are merged by timestamp with a k-way merge:
+ * the next message of every log is kept in a min-heap ordered by its time, and the earliest
+ * one is printed first. Messages with the same time are taken from the log that was given
+ * first. The lines of one log are never reordered, so the frames of a fast packet stay in
+ * the order in which they were logged.
+ *
+ * Lines are parsed by the parser that analyzer.c sets, which keeps the detected format and
+ * the fast packet reassembly state of every log apart. Lines that cannot be parsed, or whose
+ * timestamp cannot be read, take the time of the line before them in the same log.
+ * Every log is read through its own input.c reader, so compressed logs can be merged.
+ */
+
+#include "analyzer.h"
+
+typedef struct MergeInput
+{
+  FILE        *file;
+  InputReader *reader; // Opened when the merge starts
+  const char  *name;
+  char         line[MERGE_LINE_SIZE];
+  RawMessage   msg;
+  int          r;
+  uint64_t     time;
+} MergeInput;
+
+static MergeInput  inputs[MERGE_MAX_INPUTS];
+static size_t      inputCount;
+static size_t      heap[MERGE_MAX_INPUTS]; // Inputs that have a message, earliest first
+static size_t      heapCount;
+static bool        started;
+static size_t      current; // Input of the message that was returned last
+static MergeParser parser;
+
+extern void mergeAddFile(FILE *file, const char *name)
+{
+  if (inputCount == MERGE_MAX_INPUTS)
+  {
+    logAbort("At most %d -file options can be merged\n", MERGE_MAX_INPUTS);
+  }
+  inputs[inputCount].file = file;
+  inputs[inputCount].name = name;
+  inputCount++;
+}
+
+extern bool mergeEnabled(void)
+{
+  return inputCount > 1;
+}
+
+extern void mergeSetParser(MergeParser p)
+{
+  parser = p;
+}
+
+/*
+ * Read the next message of an input. Returns false at the end of the input.
+ */
+static bool readMessage(size_t i)
+{
+  MergeInput *in = &inputs[i];
+
+  while (inputReaderReadLine(in->reader, in->line, sizeof(in->line) - 1) != NULL)
+  {
+    uint64_t when;
+
+    if (!parser(i, in->line, &in->msg, &in->r))
+    {
+      continue;
+    }
+    if (in->r == 0 && parseTimestamp(in->msg.timestamp, &when))
+    {
+      in->time = when;
+    }
+    return true;
+  }
+  logDebug("End of input %zu '%s'\n", i + 1, in->name);
+  return false;
+}
+
+static bool earlier(size_t a, size_t b)
+{
+  return inputs[a].time < inputs[b].time || (inputs[a].time == inputs[b].time && a < b);
+}
+
+static void heapPush(size_t input)
+{
+  size_t i = heapCount++;
+
+  while (i > 0 && earlier(input, heap[(i - 1) / 2]))
+  {
+    heap[i] = heap[(i - 1) / 2];
+    i       = (i - 1) / 2;
+  }
+  heap[i] = input;
+}
+
+static size_t heapPop(void)
+{
+  size_t top  = heap[0];
+  size_t last = heap[--heapCount];
+  size_t i    = 0;
+
+  for (;;)
+  {
+    size_t child = 2 * i + 1;
+
+    if (child >= heapCount)
+    {
+      break;
+    }
+    if (child + 1 < heapCount && earlier(heap[child + 1], heap[child]))
+    {
+      child++;
+    }
+    if (!earlier(heap[child], last))
+    {
+      break;
+    }
+    heap[i] = heap[child];
+    i       = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/*
+ * Return the next message of all inputs in time order, with the input it came from, its
+ * line and the result of parsing it. Returns false when all inputs have ended.
+ */
+extern bool mergeNext(size_t *input, char **line, RawMessage **msg, int *r)
+{
+  if (!started)
+  {
+    for (size_t i = 0; i < inputCount; i++)
+    {
+      inputs[i].reader = inputReaderOpen(inputs[i].file);
+    }
+    for (size_t i = 0; i < inputCount; i++)
+    {
+      if (readMessage(i))
+      {
+        heapPush(i);
+      }
+    }
+    started = true;
+  }
+  else if (readMessage(current))
+  {
+    heapPush(current);
+  }
+
+  if (heapCount == 0)
+  {
+    return false;
+  }
+  current = heapPop();
+  *input  = current;
+  *line   = inputs[current].line;
+  *msg    = &inputs[current].msg;
+  *r      = inputs[current].r;
+  return true;
+}
+
+extern void mergeClose(void)
+{
+  for (size_t i = 0; i < inputCount; i++)
+  {
+    inputReaderClose(inputs[i].reader);
+    inputs[i].reader = NULL;
+  }
+}
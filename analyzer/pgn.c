@@ -24,11 +24,20 @@ limitations under the License.
 
 #include "analyzer.h"
 
+/*
+ * All NMEA 2000 PGNs are below PGN_INDEX_SIZE, so for those searchForPgn() uses a table
+ * that maps the PGN to the index of its first entry in pgnList, plus one; 0 means the PGN
+ * is not known. The table is filled by checkPgnList() at startup. The (few) CANboat
+ * specific PGNs above this range are still found with a binary search.
+ */
+#define PGN_INDEX_SIZE (0x20000)
+
+static uint16_t pgnIndex[PGN_INDEX_SIZE];
+
 /**
- * Return the first Pgn entry for which the pgn is found.
- * There can be multiple (with differing 'match' fields).
+ * Return the first Pgn entry for which the pgn is found, using a binary search.
  */
-Pgn *searchForPgn(int pgn)
+static Pgn *searchForPgnBinary(int pgn)
 {
   size_t start = 0;
   size_t end   = pgnListSize;
@@ -69,6 +78,39 @@ Pgn *searchForPgn(int pgn)
   return NULL;
 }
 
+static void fillPgnIndex(void)
+{
+  size_t i;
+
+  for (i = 0; i < pgnListSize; i++)
+  {
+    uint32_t prn = pgnList[i].pgn;
+
+    if (prn < PGN_INDEX_SIZE && pgnIndex[prn] == 0)
+    {
+      Pgn *pgn = searchForPgnBinary(prn);
+
+      if (pgn != NULL)
+      {
+        pgnIndex[prn] = (uint16_t) (pgn - pgnList + 1);
+      }
+    }
+  }
+}
+
+/**
+ * Return the first Pgn entry for which the pgn is found.
+ * There can be multiple (with differing 'match' fields).
+ */
+Pgn *searchForPgn(int pgn)
+{
+  if (pgn >= 0 && pgn < PGN_INDEX_SIZE)
+  {
+    return (pgnIndex[pgn] != 0) ? &pgnList[pgnIndex[pgn] - 1] : NULL;
+  }
+  return searchForPgnBinary(pgn);
+}
+
 /**
  * Return the last Pgn entry for which fallback == true && prn is smaller than requested.
  * This is slower, but is not used often.
@@ -180,6 +222,7 @@ void checkPgnList(void)
   size_t i;
   int    prev_prn = 0;
 
+  fillPgnIndex();
   for (i = 0; i < pgnListSize; i++)
   {
     int  pgnRangeIndex = 0;
@@ -252,6 +295,87 @@ Field *getField(uint32_t pgnId, uint32_t field)
   return 0;
 }
 
+/*
+ * Return the bit offset of a field, when this is the same for every message of this PGN:
+ * the field is not in a repeating set and is not preceded by fields of varying size.
+ */
+bool getFixedStartBit(const Pgn *pgn, const Field *field, size_t *startBit)
+{
+  const Field *f;
+
+  if ((pgn->repeatingCount1 > 0 && field->order >= pgn->repeatingStart1)
+      || (pgn->repeatingCount2 > 0 && field->order >= pgn->repeatingStart2))
+  {
+    return false;
+  }
+  *startBit = 0;
+  for (f = pgn->fieldList; f < field; f++)
+  {
+    if (f->size == 0 || f->ft->variableSize == True || f->proprietary)
+    {
+      return false;
+    }
+    *startBit += f->size;
+  }
+  return true;
+}
+
+/*
+ * Return the order that camelize() appends to the name of field <j> of <pgn>: when there is more
+ * than one Reserved or Spare field, all but the first are numbered.
+ */
+static int camelOrder(const Pgn *pgn, size_t j)
+{
+  for (size_t k = 0; k < j; k++)
+  {
+    const char *name = pgn->fieldList[k].name;
+
+    if (strcmp(name, "Reserved") == 0 || strcmp(name, "Spare") == 0)
+    {
+      return (int) j + 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Does <name> refer to this field, either by its name or by its lowerCamelCase name as -camel
+ * prints it? When -upper-camel is given its name for the field is also accepted.
+ */
+bool fieldNameMatches(const Field *field, const char *name)
+{
+  char *camel = camelize(field->name, false, camelOrder(field->pgn, field->order - 1));
+  bool  r     = strcmp(camel, name) == 0 || strcmp(field->name, name) == 0
+           || (field->camelName != NULL && strcmp(field->camelName, name) == 0);
+
+  free(camel);
+  return r;
+}
+
+/*
+ * Is this a field whose value is a single integer that extractNumber() can return?
+ */
+bool isNumericField(const Field *field)
+{
+  FieldPrintFunctionType pf = field->ft->pf;
+
+  return field->size > 0 && field->size <= 64 && field->ft->variableSize != True
+         && (pf == fieldPrintNumber || pf == fieldPrintLookup || pf == fieldPrintBitLookup || pf == fieldPrintLatLon
+             || pf == fieldPrintTime || pf == fieldPrintDate || pf == fieldPrintMMSI);
+}
+
+/*
+ * Is this the field that tells instances of a PGN from the same source apart, such as
+ * "Instance" or "Engine Instance"?
+ */
+bool isInstanceField(const Field *field)
+{
+  size_t len = strlen(field->name);
+
+  return field->size <= 8 && (field->ft->pf == fieldPrintNumber || field->ft->pf == fieldPrintLookup)
+         && (strcmp(field->name, "Instance") == 0 || (len > 9 && strcmp(field->name + len - 9, " Instance") == 0));
+}
+
 /*
  *
  * This is perhaps as good a place as any to explain how CAN messages are layed out by the
@@ -389,7 +513,7 @@ bool extractNumber(const Field *field,
   return true;
 }
 
-static char *camelize(const char *str, bool upperCamelCase, int order)
+char *camelize(const char *str, bool upperCamelCase, int order)
 {
   size_t      len         = strlen(str);
   char       *ptr         = malloc(len + 4);
@@ -436,22 +560,14 @@ static char *camelize(const char *str, bool upperCamelCase, int order)
 
 void camelCase(bool upperCamelCase)
 {
-  int  i, j;
-  bool haveEarlierSpareOrReserved;
+  int i, j;
 
   for (i = 0; i < pgnListSize; i++)
   {
     pgnList[i].camelDescription = camelize(pgnList[i].description, upperCamelCase, 0);
-    haveEarlierSpareOrReserved  = false;
     for (j = 0; j < ARRAY_SIZE(pgnList[i].fieldList) && pgnList[i].fieldList[j].name; j++)
     {
-      const char *name = pgnList[i].fieldList[j].name;
-
-      pgnList[i].fieldList[j].camelName = camelize(name, upperCamelCase, haveEarlierSpareOrReserved ? j + 1 : 0);
-      if (strcmp(name, "Reserved") == 0 || strcmp(name, "Spare") == 0)
-      {
-        haveEarlierSpareOrReserved = true;
-      }
+      pgnList[i].fieldList[j].camelName = camelize(pgnList[i].fieldList[j].name, upperCamelCase, camelOrder(&pgnList[i], j));
     }
   }
 }
@@ -67,6 +67,8 @@ typedef struct
   uint8_t val1Order;
   size_t  size;
   size_t  max;
+
+  const struct BitLookupText *bitText; // Filled by C, the rendered names of a LOOKUP_TYPE_BIT lookup
 } LookupInfo;
 
 #ifdef EXPLAIN
@@ -107,6 +109,8 @@ typedef struct
   Pgn       *pgn;
   double     rangeMin;
   double     rangeMax;
+  char     **repetitionName; // Names with repetition suffix for text output, filled on demand
+  uint8_t    notAvailable;   // How many of the highest raw values mean 'not available' and can be tested bytewise, or 0
 } Field;
 
 #include "fieldtype.h"
@@ -893,9 +897,15 @@ Pgn *endPgn(Pgn *first);
 Pgn *getMatchingPgn(int pgnId, uint8_t *dataStart, int length);
 
 bool printPgn(RawMessage *msg, uint8_t *dataStart, int length, bool showData, bool showJson);
+
+// Checks pgnList and builds the index used by searchForPgn(); call this before any lookup.
 void checkPgnList(void);
 
 Field *getField(uint32_t pgn, uint32_t field);
+bool   getFixedStartBit(const Pgn *pgn, const Field *field, size_t *startBit);
+bool   fieldNameMatches(const Field *field, const char *name);
+bool   isNumericField(const Field *field);
+bool   isInstanceField(const Field *field);
 bool   extractNumber(const Field *field,
                      uint8_t     *data,
                      size_t       dataLen,
@@ -904,7 +914,8 @@ bool   extractNumber(const Field *field,
                      int64_t     *value,
                      int64_t     *maxValue);
 
-void camelCase(bool upperCamelCase);
+void  camelCase(bool upperCamelCase);
+char *camelize(const char *str, bool upperCamelCase, int order);
 
 /* lookup.c */
 extern void fillLookups(void);
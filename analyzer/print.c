@@ -21,6 +21,9 @@ limitations under the License.
 */
 
 #include <math.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
 
 #include "analyzer.h"
 #include "common.h"
@@ -30,6 +33,23 @@ extern int g_variableFieldRepeat[2]; // Actual number of repetitions
 bool       g_skip;
 int64_t    g_previousFieldValue;
 
+/*
+ * The field printers below are written once, with the output mode as a parameter.
+ * Each is instantiated once per output mode at the end of this file, so that the
+ * compiler can resolve all of the mode tests at compile time.
+ */
+#define MODE_JSON(mode) ((mode) != OUTPUT_TEXT)
+#define MODE_JSON_NV(mode) ((mode) == OUTPUT_JSON_NV || (mode) == OUTPUT_JSON_NV_EMPTY)
+#define MODE_JSON_EMPTY(mode) ((mode) == OUTPUT_JSON_EMPTY || (mode) == OUTPUT_JSON_NV_EMPTY)
+
+static ALWAYS_INLINE bool fieldPrintBinaryMode(OutputMode mode,
+                                               Field     *field,
+                                               char      *fieldName,
+                                               uint8_t   *data,
+                                               size_t     dataLen,
+                                               size_t     startBit,
+                                               size_t    *bits);
+
 static bool unhandledStartOffset(const char *fieldName, size_t startBit)
 {
   logError("Field '%s' cannot start on bit %u\n", fieldName, startBit);
@@ -59,6 +79,24 @@ extern void mprintf(const char *format, ...)
   va_end(ap);
 }
 
+extern void mappend(const char *data, size_t len)
+{
+  size_t remain = sizeof(mbuf) - (mp - mbuf) - 1;
+
+  if (len > remain)
+  {
+    len = remain;
+  }
+  memcpy(mp, data, len);
+  mp += len;
+  *mp = '\0';
+}
+
+extern const char *mpointer(size_t location)
+{
+  return mbuf + location;
+}
+
 extern void mreset(void)
 {
   mp = mbuf;
@@ -178,11 +216,11 @@ static bool extractNumberByOrder(Pgn *pgn, size_t order, uint8_t *data, size_t d
   return extractNumber(field, data, dataLen, startBit, field->size, value, &maxValue);
 }
 
-extern void printEmpty(const char *fieldName, int64_t exceptionValue)
+static ALWAYS_INLINE void printEmptyMode(OutputMode mode, const char *fieldName, int64_t exceptionValue)
 {
-  if (showJson)
+  if (MODE_JSON(mode))
   {
-    if (showJsonEmpty)
+    if (MODE_JSON_EMPTY(mode))
     {
       mprintf("null");
     }
@@ -216,14 +254,41 @@ extern void printEmpty(const char *fieldName, int64_t exceptionValue)
   }
 }
 
-static bool extractNumberNotEmpty(const Field *field,
-                                  const char  *fieldName,
-                                  uint8_t     *data,
-                                  size_t       dataLen,
-                                  size_t       startBit,
-                                  size_t       bits,
-                                  int64_t     *value,
-                                  int64_t     *maxValue)
+extern void printEmpty(const char *fieldName, int64_t exceptionValue)
+{
+  printEmptyMode(getOutputMode(), fieldName, exceptionValue);
+}
+
+/*
+ * Remember the value of a numeric field for the fields that follow it: it may be the
+ * repeat count of a repeating field set, or the length of a following binary field.
+ */
+static void rememberFieldValue(const Field *field, int64_t value)
+{
+  if (field->pgn->repeatingField1 == field->order)
+  {
+    logDebug("The first repeating fieldset repeats %" PRId64 " times\n", value);
+    g_variableFieldRepeat[0] = value;
+  }
+
+  if (field->pgn->repeatingField2 == field->order)
+  {
+    logDebug("The second repeating fieldset repeats %" PRId64 " times\n", value);
+    g_variableFieldRepeat[1] = value;
+  }
+
+  g_previousFieldValue = value;
+}
+
+static ALWAYS_INLINE bool extractNumberNotEmpty(OutputMode   mode,
+                                                const Field *field,
+                                                const char  *fieldName,
+                                                uint8_t     *data,
+                                                size_t       dataLen,
+                                                size_t       startBit,
+                                                size_t       bits,
+                                                int64_t     *value,
+                                                int64_t     *maxValue)
 {
   int64_t reserved;
 
@@ -245,23 +310,11 @@ static bool extractNumberNotEmpty(const Field *field,
     reserved = 0;
   }
 
-  if (field->pgn->repeatingField1 == field->order)
-  {
-    logDebug("The first repeating fieldset repeats %" PRId64 " times\n", *value);
-    g_variableFieldRepeat[0] = *value;
-  }
-
-  if (field->pgn->repeatingField2 == field->order)
-  {
-    logDebug("The second repeating fieldset repeats %" PRId64 " times\n", *value);
-    g_variableFieldRepeat[1] = *value;
-  }
-
-  g_previousFieldValue = *value;
+  rememberFieldValue(field, *value);
 
   if (*value > *maxValue - reserved)
   {
-    printEmpty(fieldName, *value - *maxValue);
+    printEmptyMode(mode, fieldName, *value - *maxValue);
     return false;
   }
 
@@ -269,17 +322,23 @@ static bool extractNumberNotEmpty(const Field *field,
 }
 
 // This is only a different printer than fieldPrintNumber so the JSON can contain a string value
-extern bool fieldPrintMMSI(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintMMSIMode(OutputMode mode,
+                                             Field     *field,
+                                             char      *fieldName,
+                                             uint8_t   *data,
+                                             size_t     dataLen,
+                                             size_t     startBit,
+                                             size_t    *bits)
 {
   int64_t value;
   int64_t maxValue;
 
-  if (!extractNumberNotEmpty(field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
+  if (!extractNumberNotEmpty(mode, field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
   {
     return true;
   }
 
-  if (showJson)
+  if (MODE_JSON(mode))
   {
     mprintf("\"%09u\"", (uint32_t) value);
   }
@@ -291,14 +350,20 @@ extern bool fieldPrintMMSI(Field *field, char *fieldName, uint8_t *data, size_t
   return true;
 }
 
-extern bool fieldPrintNumber(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintNumberMode(OutputMode mode,
+                                               Field     *field,
+                                               char      *fieldName,
+                                               uint8_t   *data,
+                                               size_t     dataLen,
+                                               size_t     startBit,
+                                               size_t    *bits)
 {
   int64_t     value;
   int64_t     maxValue;
   double      a;
   const char *unit = field->unit;
 
-  if (!extractNumberNotEmpty(field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
+  if (!extractNumberNotEmpty(mode, field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
   {
     return true;
   }
@@ -307,7 +372,7 @@ extern bool fieldPrintNumber(Field *field, char *fieldName, uint8_t *data, size_
   if (field->resolution == 1.0 && field->unitOffset == 0.0)
   {
     mprintf("%" PRId64, value);
-    if (!showJson && unit != NULL)
+    if (!MODE_JSON(mode) && unit != NULL)
     {
       mprintf(" %s", unit);
     }
@@ -328,7 +393,7 @@ extern bool fieldPrintNumber(Field *field, char *fieldName, uint8_t *data, size_
       }
     }
 
-    if (showJson)
+    if (MODE_JSON(mode))
     {
       mprintf("%.*f", precision, a);
     }
@@ -349,7 +414,13 @@ extern bool fieldPrintNumber(Field *field, char *fieldName, uint8_t *data, size_
   return true;
 }
 
-extern bool fieldPrintFloat(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintFloatMode(OutputMode mode,
+                                              Field     *field,
+                                              char      *fieldName,
+                                              uint8_t   *data,
+                                              size_t     dataLen,
+                                              size_t     startBit,
+                                              size_t    *bits)
 {
   union
   {
@@ -382,14 +453,20 @@ extern bool fieldPrintFloat(Field *field, char *fieldName, uint8_t *data, size_t
 #endif
 
   mprintf("%g", f.a);
-  if (!showJson && field->unit != NULL)
+  if (!MODE_JSON(mode) && field->unit != NULL)
   {
     mprintf(" %s", field->unit);
   }
 
   return true;
 }
-extern bool fieldPrintDecimal(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintDecimalMode(OutputMode mode,
+                                                Field     *field,
+                                                char      *fieldName,
+                                                uint8_t   *data,
+                                                size_t     dataLen,
+                                                size_t     startBit,
+                                                size_t    *bits)
 {
   uint8_t  value = 0;
   uint8_t  bitMask;
@@ -443,9 +520,16 @@ extern bool fieldPrintDecimal(Field *field, char *fieldName, uint8_t *data, size
   return true;
 }
 
-extern bool fieldPrintLookup(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintLookupMode(OutputMode mode,
+                                               Field     *field,
+                                               char      *fieldName,
+                                               uint8_t   *data,
+                                               size_t     dataLen,
+                                               size_t     startBit,
+                                               size_t    *bits)
 {
   const char *s = NULL;
+  char        lookfor[20];
 
   int64_t value;
   int64_t maxValue;
@@ -458,8 +542,6 @@ extern bool fieldPrintLookup(Field *field, char *fieldName, uint8_t *data, size_
 
   if (field->unit && field->unit[0] == '=' && isdigit(field->unit[1]))
   {
-    char lookfor[20];
-
     sprintf(lookfor, "=%" PRId64, value);
     if (strcmp(lookfor, field->unit) != 0)
     {
@@ -496,11 +578,11 @@ extern bool fieldPrintLookup(Field *field, char *fieldName, uint8_t *data, size_
 
   if (s != NULL)
   {
-    if (showJsonValue)
+    if (MODE_JSON_NV(mode))
     {
       mprintf("%" PRId64 ",\"name\":\"%s\"}", value, s);
     }
-    else if (showJson)
+    else if (MODE_JSON(mode))
     {
       mprintf("\"%s\"", s);
     }
@@ -513,18 +595,18 @@ extern bool fieldPrintLookup(Field *field, char *fieldName, uint8_t *data, size_
   {
     if (*bits > 1 && (value >= maxValue - (*bits > 2 ? 2 : 1)))
     {
-      printEmpty(fieldName, value - maxValue);
+      printEmptyMode(mode, fieldName, value - maxValue);
     }
-    else if (showJsonValue)
+    else if (MODE_JSON_NV(mode))
     {
       mprintf("%" PRId64, value);
-      if (showJsonEmpty)
+      if (MODE_JSON_EMPTY(mode))
       {
         mprintf(",\"name\":null");
       }
       mprintf("}");
     }
-    else if (showJson)
+    else if (MODE_JSON(mode))
     {
       mprintf("%" PRId64, value);
     }
@@ -541,7 +623,13 @@ extern bool fieldPrintLookup(Field *field, char *fieldName, uint8_t *data, size_
  * Only print reserved fields if they are NOT all ones, in that case we have an incorrect
  * PGN definition.
  */
-extern bool fieldPrintReserved(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintReservedMode(OutputMode mode,
+                                                 Field     *field,
+                                                 char      *fieldName,
+                                                 uint8_t   *data,
+                                                 size_t     dataLen,
+                                                 size_t     startBit,
+                                                 size_t    *bits)
 {
   int64_t value;
   int64_t maxValue;
@@ -556,14 +644,20 @@ extern bool fieldPrintReserved(Field *field, char *fieldName, uint8_t *data, siz
     return true;
   }
 
-  return fieldPrintBinary(field, fieldName, data, dataLen, startBit, bits);
+  return fieldPrintBinaryMode(mode, field, fieldName, data, dataLen, startBit, bits);
 }
 
 /*
  * Only print spare fields if they are NOT all zeroes, in that case we have an incorrect
  * PGN definition.
  */
-extern bool fieldPrintSpare(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintSpareMode(OutputMode mode,
+                                              Field     *field,
+                                              char      *fieldName,
+                                              uint8_t   *data,
+                                              size_t     dataLen,
+                                              size_t     startBit,
+                                              size_t    *bits)
 {
   int64_t value;
   int64_t maxValue;
@@ -578,16 +672,79 @@ extern bool fieldPrintSpare(Field *field, char *fieldName, uint8_t *data, size_t
     return true;
   }
 
-  return fieldPrintBinary(field, fieldName, data, dataLen, startBit, bits);
+  return fieldPrintBinaryMode(mode, field, fieldName, data, dataLen, startBit, bits);
 }
 
-extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+/*
+ * The rendered output for every bit of a LOOKUP_TYPE_BIT lookup, for one output mode.
+ * This is built once at startup by fillBitLookups() and shared by all fields that use
+ * the same lookup.
+ */
+struct BitLookupText
 {
-  int64_t value;
-  int64_t maxValue;
-  int64_t bitValue;
-  size_t  bit;
-  char   *sep;
+  OutputMode mode;
+  const char *(*function)(size_t val);
+  char  *text[64];
+  size_t len[64];
+};
+
+/*
+ * Return the number of the lowest bit that is set in v, which must not be 0.
+ */
+static ALWAYS_INLINE unsigned int lowestSetBit(uint64_t v)
+{
+#ifdef __GNUC__
+  return (unsigned int) __builtin_ctzll(v);
+#else
+  unsigned int bit = 0;
+
+  while ((v & 1) == 0)
+  {
+    v >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+static void printBitLookupName(OutputMode mode, const char *s, int64_t bitValue)
+{
+  if (s != NULL)
+  {
+    if (MODE_JSON_NV(mode))
+    {
+      mprintf("{\"value\":%" PRId64 ",\"name\":\"%s\"}", bitValue, s);
+    }
+    else if (MODE_JSON(mode))
+    {
+      mprintf("\"%s\"", s);
+    }
+    else
+    {
+      mprintf("%s", s);
+    }
+  }
+  else
+  {
+    mprintf("\"%" PRIu64 "\"", bitValue);
+  }
+}
+
+static ALWAYS_INLINE bool fieldPrintBitLookupMode(OutputMode mode,
+                                                  Field     *field,
+                                                  char      *fieldName,
+                                                  uint8_t   *data,
+                                                  size_t     dataLen,
+                                                  size_t     startBit,
+                                                  size_t    *bits)
+{
+  int64_t                     value;
+  int64_t                     maxValue;
+  int64_t                     bitValue;
+  uint64_t                    setBits;
+  size_t                      bit;
+  char                       *sep;
+  const struct BitLookupText *bitText = field->lookup.bitText;
 
   if (!extractNumber(field, data, dataLen, startBit, *bits, &value, &maxValue))
   {
@@ -595,9 +752,9 @@ extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, si
   }
   if (value == 0)
   {
-    if (showJson)
+    if (MODE_JSON(mode))
     {
-      printEmpty(fieldName, value - maxValue);
+      printEmptyMode(mode, fieldName, value - maxValue);
     }
     else
     {
@@ -608,11 +765,11 @@ extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, si
 
   logDebug("RES_BITFIELD length %u value %" PRIx64 "\n", *bits, value);
 
-  if (showJsonValue)
+  if (MODE_JSON_NV(mode))
   {
     sep = "[";
   }
-  else if (showJson)
+  else if (MODE_JSON(mode))
   {
     sep = "[";
   }
@@ -621,37 +778,25 @@ extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, si
     sep = "";
   }
 
-  for (bitValue = 1, bit = 0; bitValue <= maxValue; (bitValue *= 2), bit++)
+  // Only visit the bits that are set, lowest first
+  for (setBits = (uint64_t) value & (uint64_t) maxValue; setBits != 0; setBits &= setBits - 1)
   {
-    bool isSet = (value & bitValue) != 0;
-    logDebug("RES_BITFIELD is bit %u value %" PRIx64 " set? = %d\n", bit, bitValue, isSet);
-    if (isSet)
-    {
-      const char *s = (*field->lookup.function.pair)(bit);
+    bit      = lowestSetBit(setBits);
+    bitValue = (int64_t) (UINT64_C(1) << bit);
+    logDebug("RES_BITFIELD bit %u value %" PRIx64 " is set\n", bit, bitValue);
 
-      if (s != NULL)
-      {
-        if (showJsonValue)
-        {
-          mprintf("%s{\"value\":%" PRId64 ",\"name\":\"%s\"}", sep, bitValue, s);
-        }
-        else if (showJson)
-        {
-          mprintf("%s\"%s\"", sep, s);
-        }
-        else
-        {
-          mprintf("%s%s", sep, s);
-        }
-      }
-      else
-      {
-        mprintf("%s\"%" PRIu64 "\"", sep, bitValue);
-      }
-      sep = ",";
+    mappend(sep, strlen(sep));
+    sep = ",";
+    if (bitText != NULL && bitText->mode == mode)
+    {
+      mappend(bitText->text[bit], bitText->len[bit]);
+    }
+    else
+    {
+      printBitLookupName(mode, field->lookup.function.pair(bit), bitValue);
     }
   }
-  if (showJson)
+  if (MODE_JSON(mode))
   {
     if (*sep != '[')
     {
@@ -665,7 +810,13 @@ extern bool fieldPrintBitLookup(Field *field, char *fieldName, uint8_t *data, si
   return true;
 }
 
-extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintLatLonMode(OutputMode mode,
+                                               Field     *field,
+                                               char      *fieldName,
+                                               uint8_t   *data,
+                                               size_t     dataLen,
+                                               size_t     startBit,
+                                               size_t    *bits)
 {
   uint64_t absVal;
   int64_t  value;
@@ -679,7 +830,7 @@ extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_
 
   logDebug("fieldPrintLatLon for '%s' startbit=%zu bits=%zu\n", fieldName, startBit, *bits);
 
-  if (!extractNumberNotEmpty(field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
+  if (!extractNumberNotEmpty(mode, field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
   {
     return true;
   }
@@ -693,7 +844,7 @@ extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_
   }
   else
   {
-    if (showJsonValue)
+    if (MODE_JSON_NV(mode))
     {
       mprintf("%" PRId64 ",\"name\":", value);
     }
@@ -704,7 +855,7 @@ extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_
       remainder = dd - degrees;
       minutes   = remainder * 60.;
 
-      mprintf((showJson ? "\"%02u&deg; %6.3f %c\"" : "%02ud %6.3f %c"),
+      mprintf((MODE_JSON(mode) ? "\"%02u&deg; %6.3f %c\"" : "%02ud %6.3f %c"),
               (uint32_t) degrees,
               minutes,
               (isLongitude ? ((value >= 0) ? 'E' : 'W') : ((value >= 0) ? 'N' : 'S')));
@@ -717,13 +868,13 @@ extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_
       minutes   = floor(remainder * 60.);
       seconds   = floor(remainder * 3600.) - 60. * minutes;
 
-      mprintf((showJson ? "\"%02u&deg;%02u&rsquo;%06.3f&rdquo;%c\"" : "%02ud %02u' %06.3f\"%c"),
+      mprintf((MODE_JSON(mode) ? "\"%02u&deg;%02u&rsquo;%06.3f&rdquo;%c\"" : "%02ud %02u' %06.3f\"%c"),
               (int) degrees,
               (int) minutes,
               seconds,
               (isLongitude ? ((value >= 0) ? 'E' : 'W') : ((value >= 0) ? 'N' : 'S')));
     }
-    if (showJsonValue)
+    if (MODE_JSON_NV(mode))
     {
       mprintf("}");
     }
@@ -731,19 +882,25 @@ extern bool fieldPrintLatLon(Field *field, char *fieldName, uint8_t *data, size_
   return true;
 }
 
-extern bool fieldPrintTime(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintTimeMode(OutputMode mode,
+                                             Field     *field,
+                                             char      *fieldName,
+                                             uint8_t   *data,
+                                             size_t     dataLen,
+                                             size_t     startBit,
+                                             size_t    *bits)
 {
   uint64_t unitspersecond;
-  uint32_t hours;
-  uint32_t minutes;
   uint32_t seconds;
   uint32_t units;
   int64_t  value;
   int64_t  maxValue;
   uint64_t t;
   int      digits;
+  char     buf[sizeof("1193046:28:15.") + 20];
+  size_t   len;
 
-  if (!extractNumberNotEmpty(field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
+  if (!extractNumberNotEmpty(mode, field, fieldName, data, dataLen, startBit, *bits, &value, &maxValue))
   {
     return true;
   }
@@ -769,52 +926,47 @@ extern bool fieldPrintTime(Field *field, char *fieldName, uint8_t *data, size_t
 
   seconds = t / unitspersecond;
   units   = t % unitspersecond;
-  minutes = seconds / 60;
-  seconds = seconds % 60;
-  hours   = minutes / 60;
-  minutes = minutes % 60;
 
   digits = log10(unitspersecond);
 
-  if (showJson)
+  len = formatTimeOfDay(buf, seconds);
+  if (units != 0)
+  {
+    buf[len++] = '.';
+    len += formatUnsigned(buf + len, units, digits);
+  }
+
+  if (MODE_JSON(mode))
   {
-    if (showJsonValue)
+    if (MODE_JSON_NV(mode))
     {
       mprintf("%" PRIu64 ",\"name\":", t);
     }
-    if (units != 0)
-    {
-      mprintf("\"%02u:%02u:%02u.%0*u\"", hours, minutes, seconds, digits, units);
-    }
-    else
-    {
-      mprintf("\"%02u:%02u:%02u\"", hours, minutes, seconds);
-    }
-    if (showJsonValue)
+    mappend("\"", 1);
+    mappend(buf, len);
+    mappend("\"", 1);
+    if (MODE_JSON_NV(mode))
     {
-      mprintf("}");
+      mappend("}", 1);
     }
   }
   else
   {
-    if (units)
-    {
-      mprintf("%02u:%02u:%02u.%0*u", hours, minutes, seconds, digits, units);
-    }
-    else
-    {
-      mprintf("%02u:%02u:%02u", hours, minutes, seconds);
-    }
+    mappend(buf, len);
   }
   return true;
 }
 
-extern bool fieldPrintDate(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintDateMode(OutputMode mode,
+                                             Field     *field,
+                                             char      *fieldName,
+                                             uint8_t   *data,
+                                             size_t     dataLen,
+                                             size_t     startBit,
+                                             size_t    *bits)
 {
-  char       buf[sizeof("2008.03.10") + 1];
-  time_t     t;
-  struct tm *tm;
-  uint16_t   d;
+  char     buf[sizeof("2008.03.10") + 1];
+  uint16_t d;
 
   if (!adjustDataLenStart(&data, &dataLen, &startBit))
   {
@@ -838,20 +990,14 @@ extern bool fieldPrintDate(Field *field, char *fieldName, uint8_t *data, size_t
 
   if (d >= 0xfffd)
   {
-    printEmpty(fieldName, d - INT64_C(0xffff));
+    printEmptyMode(mode, fieldName, d - INT64_C(0xffff));
     return true;
   }
 
-  t  = d * 86400;
-  tm = gmtime(&t);
-  if (!tm)
+  formatDate(buf, d, '.');
+  if (MODE_JSON(mode))
   {
-    logAbort("Unable to convert %u to gmtime\n", (unsigned int) t);
-  }
-  strftime(buf, sizeof(buf), "%Y.%m.%d", tm);
-  if (showJson)
-  {
-    if (showJsonValue)
+    if (MODE_JSON_NV(mode))
     {
       mprintf("%" PRIu16 ",\"name\":\"%s\"}", d, buf);
     }
@@ -867,6 +1013,170 @@ extern bool fieldPrintDate(Field *field, char *fieldName, uint8_t *data, size_t
   return true;
 }
 
+/*
+ * Byte-wise tests on a 64 bit word, see "Bit Twiddling Hacks": is there a byte less than n (n <= 128),
+ * is there a byte equal to n?
+ */
+#define SWAR_ONES UINT64_C(0x0101010101010101)
+#define SWAR_HIGH UINT64_C(0x8080808080808080)
+#define SWAR_HAS_LESS(x, n) (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGH)
+#define SWAR_HAS_BYTE(x, n) SWAR_HAS_LESS((x) ^ (SWAR_ONES * (n)), 1)
+
+/*
+ * Return the number of bytes at the start of `data` that can be copied to the output
+ * unchanged, e.g. that do not need JSON escaping and are not NUL or 0xff. Some control
+ * characters that do not need escaping are also reported; they are handled by the
+ * slow path in print_ascii_json_escaped().
+ */
+static size_t jsonPlainSpan(const uint8_t *data, size_t len)
+{
+  size_t k = 0;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  const __m128i ctrlMax   = _mm_set1_epi8(0x0d); // '\r', the highest control character that is escaped
+  const __m128i quote     = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i slash     = _mm_set1_epi8('/');
+  const __m128i allOnes   = _mm_set1_epi8((char) 0xff);
+
+  for (; k + 16 <= len; k += 16)
+  {
+    __m128i v       = _mm_loadu_si128((const __m128i *) (data + k));
+    __m128i special = _mm_cmpeq_epi8(_mm_max_epu8(v, ctrlMax), ctrlMax); // v <= 0x0d
+    int     mask;
+
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(v, quote));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(v, backslash));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(v, slash));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(v, allOnes));
+    mask    = _mm_movemask_epi8(special);
+    if (mask != 0)
+    {
+      return k + __builtin_ctz(mask);
+    }
+  }
+#else
+  // Test 8 bytes at a time using SWAR (SIMD within a register)
+  for (; k + 8 <= len; k += 8)
+  {
+    uint64_t v;
+
+    memcpy(&v, data + k, sizeof(v));
+    if (SWAR_HAS_LESS(v, 0x0e) || SWAR_HAS_BYTE(v, '"') || SWAR_HAS_BYTE(v, '\\') || SWAR_HAS_BYTE(v, '/')
+        || SWAR_HAS_BYTE(v, 0xff))
+    {
+      break;
+    }
+  }
+#endif
+
+  for (; k < len; k++)
+  {
+    uint8_t c = data[k];
+
+    if (c <= 0x0d || c == '"' || c == '\\' || c == '/' || c == 0xff)
+    {
+      break;
+    }
+  }
+  return k;
+}
+
+/*
+ * Most devices fill the fields they do not support with 0xff bytes. Before the fields of a
+ * message are printed, allOnesMask gets one bit per payload byte that is set when that byte
+ * is 0xff, so fieldNotAvailable() can decide whether a byte aligned field is "not available"
+ * without extracting and formatting it.
+ */
+#define ALL_ONES_MAX_BYTES (2048)
+
+static uint64_t       allOnesMask[ALL_ONES_MAX_BYTES / 64];
+static const uint8_t *allOnesData;
+static size_t         allOnesLen;
+
+extern void setAllOnesMask(const uint8_t *data, size_t len)
+{
+  size_t i = 0;
+
+  if (len > ALL_ONES_MAX_BYTES)
+  {
+    allOnesData = NULL;
+    return;
+  }
+  memset(allOnesMask, 0, (len + 63) / 64 * sizeof(allOnesMask[0]));
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  const __m128i ff = _mm_set1_epi8((char) 0xff);
+
+  for (; i + 16 <= len; i += 16)
+  {
+    uint64_t bits = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + i)), ff));
+
+    allOnesMask[i / 64] |= bits << (i % 64);
+  }
+#endif
+  for (; i < len; i++)
+  {
+    if (data[i] == 0xff)
+    {
+      allOnesMask[i / 64] |= UINT64_C(1) << (i % 64);
+    }
+  }
+  allOnesData = data;
+  allOnesLen  = len;
+}
+
+// Are `bytes` (at most 8) bytes starting at `start` all 0xff?
+static bool allOnesRange(size_t start, size_t bytes)
+{
+  uint64_t want = (bytes >= 64) ? UINT64_MAX : (UINT64_C(1) << bytes) - 1;
+  uint64_t have = allOnesMask[start / 64] >> (start % 64);
+
+  if (start % 64 + bytes > 64)
+  {
+    have |= allOnesMask[start / 64 + 1] << (64 - start % 64);
+  }
+  return (have & want) == want;
+}
+
+/*
+ * Return true when the field is byte aligned and its raw value is one of the `notAvailable`
+ * reserved values (all ones, and for numbers also all ones minus one), in which case it is
+ * not printed in JSON mode. The side effects that extracting the value would have had
+ * are applied.
+ */
+extern bool fieldNotAvailable(const Field *field, const uint8_t *data, size_t startBit, size_t bits)
+{
+  size_t  start = startBit / 8;
+  size_t  bytes = bits / 8;
+  int64_t maxValue;
+
+  if (field->notAvailable == 0 || data != allOnesData || startBit % 8 != 0 || bits != field->size
+      || start + bytes > allOnesLen)
+  {
+    return false;
+  }
+  if (!allOnesRange(start + 1, bytes - 1))
+  {
+    return false;
+  }
+  maxValue = (int64_t) ((bits >= 64) ? UINT64_MAX : (UINT64_C(1) << bits) - 1);
+  if (data[start] == 0xff)
+  {
+    if (field->notAvailable > 1)
+    {
+      rememberFieldValue(field, maxValue);
+    }
+    return true;
+  }
+  if (data[start] == 0xfe && field->notAvailable > 1)
+  {
+    rememberFieldValue(field, maxValue - 1);
+    return true;
+  }
+  return false;
+}
+
 static void print_ascii_json_escaped(uint8_t *data, int len)
 {
   int c;
@@ -874,39 +1184,52 @@ static void print_ascii_json_escaped(uint8_t *data, int len)
 
   for (k = 0; k < len; k++)
   {
+    size_t plain = jsonPlainSpan(data + k, len - k);
+
+    if (plain > 0)
+    {
+      // Copy the run of characters that need no escaping in one go
+      mappend((const char *) data + k, plain);
+      k += plain;
+      if (k >= len)
+      {
+        break;
+      }
+    }
+
     c = data[k];
     switch (c)
     {
       case '\b':
-        mprintf("%s", "\\b");
+        mappend("\\b", 2);
         break;
 
       case '\n':
-        mprintf("%s", "\\n");
+        mappend("\\n", 2);
         break;
 
       case '\r':
-        mprintf("%s", "\\r");
+        mappend("\\r", 2);
         break;
 
       case '\t':
-        mprintf("%s", "\\t");
+        mappend("\\t", 2);
         break;
 
       case '\f':
-        mprintf("%s", "\\f");
+        mappend("\\f", 2);
         break;
 
       case '"':
-        mprintf("%s", "\\\"");
+        mappend("\\\"", 2);
         break;
 
       case '\\':
-        mprintf("%s", "\\\\");
+        mappend("\\\\", 2);
         break;
 
       case '/':
-        mprintf("%s", "\\/");
+        mappend("\\/", 2);
         break;
 
       case '\377':
@@ -917,13 +1240,13 @@ static void print_ascii_json_escaped(uint8_t *data, int len)
       default:
         if (c > 0x00)
         {
-          mprintf("%c", c);
+          mappend((const char *) data + k, 1);
         }
     }
   }
 }
 
-static bool printString(char *fieldName, uint8_t *data, size_t len)
+static ALWAYS_INLINE bool printString(OutputMode mode, char *fieldName, uint8_t *data, size_t len)
 {
   uint8_t *lastbyte;
 
@@ -940,11 +1263,11 @@ static bool printString(char *fieldName, uint8_t *data, size_t len)
 
   if (len == 0)
   {
-    printEmpty(fieldName, DATAFIELD_UNKNOWN);
+    printEmptyMode(mode, fieldName, DATAFIELD_UNKNOWN);
     return true;
   }
 
-  if (showJson)
+  if (MODE_JSON(mode))
   {
     mprintf("\"");
     print_ascii_json_escaped(data, len);
@@ -961,7 +1284,13 @@ static bool printString(char *fieldName, uint8_t *data, size_t len)
 /**
  * Fixed length string where the length is defined by the field definition.
  */
-extern bool fieldPrintStringFix(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintStringFixMode(OutputMode mode,
+                                                  Field     *field,
+                                                  char      *fieldName,
+                                                  uint8_t   *data,
+                                                  size_t     dataLen,
+                                                  size_t     startBit,
+                                                  size_t    *bits)
 {
   size_t len = field->size / 8;
 
@@ -974,10 +1303,16 @@ extern bool fieldPrintStringFix(Field *field, char *fieldName, uint8_t *data, si
 
   len   = CB_MIN(len, dataLen); // Cap length to remaining bytes in message
   *bits = BYTES(len);
-  return printString(fieldName, data, len);
+  return printString(mode, fieldName, data, len);
 }
 
-extern bool fieldPrintStringLZ(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintStringLZMode(OutputMode mode,
+                                                 Field     *field,
+                                                 char      *fieldName,
+                                                 uint8_t   *data,
+                                                 size_t     dataLen,
+                                                 size_t     startBit,
+                                                 size_t    *bits)
 {
   // STRINGLZ format is <len> [ <data> ... ]
   size_t len;
@@ -992,19 +1327,23 @@ extern bool fieldPrintStringLZ(Field *field, char *fieldName, uint8_t *data, siz
   len   = CB_MIN(len, dataLen - 1);
   *bits = BYTES(len + 1);
 
-  return printString(fieldName, data, len);
+  return printString(mode, fieldName, data, len);
 }
 
-extern bool fieldPrintStringLAU(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintStringLAUMode(OutputMode mode,
+                                                  Field     *field,
+                                                  char      *fieldName,
+                                                  uint8_t   *data,
+                                                  size_t     dataLen,
+                                                  size_t     startBit,
+                                                  size_t    *bits)
 {
   // STRINGLAU format is <len> <control> [ <data> ... ]
   // where <control> == 0 = UTF16
   //       <control> == 1 = ASCII(?) or maybe UTF8?
-  int     control;
-  size_t  len;
-  size_t  utf8_len;
-  utf8_t *utf8 = NULL;
-  bool    r;
+  int    control;
+  size_t len;
+  utf8_t utf8[3 * 128]; // <len> is a byte, so at most 127 UTF-16 units each needing at most 3 bytes
 
   if (!adjustDataLenStart(&data, &dataLen, &startBit))
   {
@@ -1025,16 +1364,9 @@ extern bool fieldPrintStringLAU(Field *field, char *fieldName, uint8_t *data, si
 
   if (control == 0)
   {
-    utf8_len = utf16_to_utf8((const utf16_t *) data, len / 2, NULL, 0);
-    utf8     = malloc(utf8_len + 1);
-
-    if (utf8 == NULL)
-    {
-      die("Out of memory");
-    }
-    logDebug("fieldprintStringLAU: UTF16 len %zu requires %zu utf8 bytes\n", len / 2, utf8_len);
-    len  = utf16_to_utf8((const utf16_t *) data, len / 2, utf8, utf8_len + 1);
+    len  = utf16_to_utf8((const utf16_t *) data, len / 2, utf8, sizeof(utf8));
     data = utf8;
+    logDebug("fieldprintStringLAU: UTF16 converted to %zu utf8 bytes\n", len);
   }
   else if (control > 1)
   {
@@ -1042,15 +1374,16 @@ extern bool fieldPrintStringLAU(Field *field, char *fieldName, uint8_t *data, si
     return false;
   }
 
-  r = printString(fieldName, data, len);
-  if (utf8 != NULL)
-  {
-    free(utf8);
-  }
-  return r;
+  return printString(mode, fieldName, data, len);
 }
 
-extern bool fieldPrintBinary(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits)
+static ALWAYS_INLINE bool fieldPrintBinaryMode(OutputMode mode,
+                                               Field     *field,
+                                               char      *fieldName,
+                                               uint8_t   *data,
+                                               size_t     dataLen,
+                                               size_t     startBit,
+                                               size_t    *bits)
 {
   size_t      i;
   size_t      remaining_bits;
@@ -1073,7 +1406,7 @@ extern bool fieldPrintBinary(Field *field, char *fieldName, uint8_t *data, size_
     *bits = dataLen * 8 - startBit;
   }
 
-  if (showJson)
+  if (MODE_JSON(mode))
   {
     mprintf("\"");
   }
@@ -1105,9 +1438,170 @@ extern bool fieldPrintBinary(Field *field, char *fieldName, uint8_t *data, size_
     mprintf("%s%2.02X", s, byte);
     s = " ";
   }
-  if (showJson)
+  if (MODE_JSON(mode))
   {
     mprintf("\"");
   }
   return true;
 }
+
+extern OutputMode getOutputMode(void)
+{
+  if (!showJson)
+  {
+    return OUTPUT_TEXT;
+  }
+  if (showJsonValue)
+  {
+    return showJsonEmpty ? OUTPUT_JSON_NV_EMPTY : OUTPUT_JSON_NV;
+  }
+  return showJsonEmpty ? OUTPUT_JSON_EMPTY : OUTPUT_JSON;
+}
+
+/*
+ * Generate, for every field printer, one copy per output mode plus the generic
+ * version that is referenced from the fieldTypeList. The generic version derives
+ * the mode from the show* flags on every call.
+ */
+#define FIELD_PRINTER_VARIANT(fn, mode)                                                                                \
+  static bool fn##_##mode(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits) \
+  {                                                                                                                    \
+    return fn##Mode(mode, field, fieldName, data, dataLen, startBit, bits);                                            \
+  }
+
+#define FIELD_PRINTER(fn)                                                                                     \
+  FIELD_PRINTER_VARIANT(fn, OUTPUT_TEXT)                                                                      \
+  FIELD_PRINTER_VARIANT(fn, OUTPUT_JSON)                                                                      \
+  FIELD_PRINTER_VARIANT(fn, OUTPUT_JSON_EMPTY)                                                                \
+  FIELD_PRINTER_VARIANT(fn, OUTPUT_JSON_NV)                                                                   \
+  FIELD_PRINTER_VARIANT(fn, OUTPUT_JSON_NV_EMPTY)                                                             \
+  extern bool fn(Field *field, char *fieldName, uint8_t *data, size_t dataLen, size_t startBit, size_t *bits) \
+  {                                                                                                           \
+    return fn##Mode(getOutputMode(), field, fieldName, data, dataLen, startBit, bits);                        \
+  }
+
+#define FIELD_PRINTER_ENTRY(fn)                                                                                        \
+  {                                                                                                                    \
+    fn, { fn##_OUTPUT_TEXT, fn##_OUTPUT_JSON, fn##_OUTPUT_JSON_EMPTY, fn##_OUTPUT_JSON_NV, fn##_OUTPUT_JSON_NV_EMPTY } \
+  }
+
+FIELD_PRINTER(fieldPrintBinary)
+FIELD_PRINTER(fieldPrintBitLookup)
+FIELD_PRINTER(fieldPrintDate)
+FIELD_PRINTER(fieldPrintDecimal)
+FIELD_PRINTER(fieldPrintFloat)
+FIELD_PRINTER(fieldPrintLatLon)
+FIELD_PRINTER(fieldPrintLookup)
+FIELD_PRINTER(fieldPrintMMSI)
+FIELD_PRINTER(fieldPrintNumber)
+FIELD_PRINTER(fieldPrintReserved)
+FIELD_PRINTER(fieldPrintSpare)
+FIELD_PRINTER(fieldPrintStringFix)
+FIELD_PRINTER(fieldPrintStringLAU)
+FIELD_PRINTER(fieldPrintStringLZ)
+FIELD_PRINTER(fieldPrintTime)
+
+static const struct
+{
+  FieldPrintFunctionType generic;
+  FieldPrintFunctionType variant[OUTPUT_MODE_COUNT];
+} fieldPrinters[] = {FIELD_PRINTER_ENTRY(fieldPrintBinary),
+                     FIELD_PRINTER_ENTRY(fieldPrintBitLookup),
+                     FIELD_PRINTER_ENTRY(fieldPrintDate),
+                     FIELD_PRINTER_ENTRY(fieldPrintDecimal),
+                     FIELD_PRINTER_ENTRY(fieldPrintFloat),
+                     FIELD_PRINTER_ENTRY(fieldPrintLatLon),
+                     FIELD_PRINTER_ENTRY(fieldPrintLookup),
+                     FIELD_PRINTER_ENTRY(fieldPrintMMSI),
+                     FIELD_PRINTER_ENTRY(fieldPrintNumber),
+                     FIELD_PRINTER_ENTRY(fieldPrintReserved),
+                     FIELD_PRINTER_ENTRY(fieldPrintSpare),
+                     FIELD_PRINTER_ENTRY(fieldPrintStringFix),
+                     FIELD_PRINTER_ENTRY(fieldPrintStringLAU),
+                     FIELD_PRINTER_ENTRY(fieldPrintStringLZ),
+                     FIELD_PRINTER_ENTRY(fieldPrintTime)};
+
+/*
+ * Return the variant of a field printer that is specialised for `mode`.
+ * Printers that are not generated here (fieldPrintVariable) are returned as-is.
+ */
+extern FieldPrintFunctionType getFieldPrinter(FieldPrintFunctionType pf, OutputMode mode)
+{
+  for (size_t i = 0; i < ARRAY_SIZE(fieldPrinters); i++)
+  {
+    if (fieldPrinters[i].generic == pf)
+    {
+      return fieldPrinters[i].variant[mode];
+    }
+  }
+  return pf;
+}
+
+/*
+ * Render the names of every bit of every LOOKUP_TYPE_BIT lookup once, so that fieldPrintBitLookup
+ * only has to copy the text for the bits that are set.
+ */
+extern void fillBitLookups(OutputMode mode)
+{
+#ifndef EXPLAIN
+  struct BitLookupText **list  = NULL;
+  size_t                 count = 0;
+
+  for (size_t i = 0; i < pgnListSize; i++)
+  {
+    for (size_t j = 0; pgnList[i].fieldList[j].name != NULL; j++)
+    {
+      Field                *f = &pgnList[i].fieldList[j];
+      struct BitLookupText *t = NULL;
+
+      if (f->lookup.type != LOOKUP_TYPE_BIT || f->lookup.function.pair == NULL)
+      {
+        continue;
+      }
+
+      for (size_t k = 0; k < count; k++)
+      {
+        if (list[k]->function == f->lookup.function.pair)
+        {
+          t = list[k];
+          break;
+        }
+      }
+
+      if (t == NULL)
+      {
+        size_t mark = mlocation();
+
+        t    = malloc(sizeof(*t));
+        list = realloc(list, (count + 1) * sizeof(*list));
+        if (t == NULL || list == NULL)
+        {
+          die("Out of memory");
+        }
+        list[count++] = t;
+        t->mode       = mode;
+        t->function   = f->lookup.function.pair;
+
+        // Render through the message buffer so the output is exactly what printBitLookupName produces
+        for (size_t bit = 0; bit < ARRAY_SIZE(t->text); bit++)
+        {
+          printBitLookupName(mode, t->function(bit), (int64_t) (UINT64_C(1) << bit));
+          t->len[bit]  = mlocation() - mark;
+          t->text[bit] = malloc(t->len[bit]);
+          if (t->text[bit] == NULL)
+          {
+            die("Out of memory");
+          }
+          memcpy(t->text[bit], mpointer(mark), t->len[bit]);
+          mset(mark);
+        }
+      }
+      f->lookup.bitText = t;
+    }
+  }
+  logDebug("Rendered %zu bit lookups\n", count);
+  free(list);
+#else
+  (void) mode;
+#endif
+}
@@ -0,0 +1,190 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Time range and indexed reading.
+ *
+ * -from <time> skips messages before <time>, and -to <time> stops at the first message
+ * after <time>. The times are timestamps as in the log, e.g. 2023-01-01T14:03:00Z.
+ *
+ * When the log is read with -file and there is a sidecar index <file>.idx written by
+ * logindex, only the blocks of the log that can hold messages in the time range and of
+ * the selected PGN and source are read; the others are skipped with a seek.
+ *
+ * Without an index a log in PLAIN or FAST format that is a regular file is searched for
+ * the -from time with a binary search on the byte offset, as these logs are written in
+ * time order.
+ */
+
+#include "analyzer.h"
+#include "logindex.h"
+
+static bool     haveFrom;
+static bool     haveTo;
+static uint64_t rangeFrom;
+static uint64_t rangeTo;
+
+static LogIndex logIndex;
+static bool     indexed;
+static size_t   indexNext;   // Next block to consider
+static uint64_t indexEnd;    // Offset where the block being read ends
+static uint64_t position;    // Offset of the next line
+static int      indexPgn;    // PGN to select blocks on, or 0
+static int      indexSrc;    // Source to select blocks on, or -1
+static uint64_t blocksRead;
+
+extern void rangeSetFrom(const char *from)
+{
+  if (!parseTimestamp(from, &rangeFrom))
+  {
+    logAbort("Invalid -from time '%s'\n", from);
+  }
+  haveFrom = true;
+}
+
+extern void rangeSetTo(const char *to)
+{
+  if (!parseTimestamp(to, &rangeTo))
+  {
+    logAbort("Invalid -to time '%s'\n", to);
+  }
+  haveTo = true;
+}
+
+/*
+ * Load the index of log file <name>, when there is a time range, PGN or source to select on.
+ * Without an index, seek to the -from time when the log is ordered by time.
+ */
+extern void rangeOpen(FILE *file, const char *name, int onlyPgn, int onlySrc, bool timeOrdered)
+{
+  if (name != NULL && (haveFrom || haveTo || onlyPgn > 0 || onlySrc >= 0))
+  {
+    indexed  = logIndexLoad(name, &logIndex);
+    indexPgn = onlyPgn;
+    indexSrc = onlySrc;
+  }
+  if (indexed)
+  {
+    logDebug("Using index of %s with %" PRIu64 " blocks\n", name, logIndex.header.blockCount);
+  }
+  else if (haveFrom && timeOrdered)
+  {
+    logSeekTime(file, rangeFrom, logIndexLineTime);
+  }
+}
+
+static bool blockWanted(const LogIndexBlock *block)
+{
+  if (haveFrom && block->lastTime < rangeFrom)
+  {
+    return false;
+  }
+  if (haveTo && block->firstTime > rangeTo)
+  {
+    return false;
+  }
+  if (indexPgn > 0 && !logIndexBlockHasPgn(block, indexPgn))
+  {
+    return false;
+  }
+  if (indexSrc >= 0 && !logIndexBlockHasSrc(block, indexSrc))
+  {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Seek to the next block of the index that is wanted. When there is none, continue after the
+ * part of the log that is covered by the index.
+ */
+static void seekNextBlock(FILE *file)
+{
+  uint64_t offset = logIndex.header.logSize;
+
+  while (indexNext < logIndex.header.blockCount && !blockWanted(&logIndex.block[indexNext]))
+  {
+    indexNext++;
+  }
+  if (indexNext < logIndex.header.blockCount)
+  {
+    offset   = logIndex.block[indexNext].offset;
+    indexEnd = (indexNext + 1 < logIndex.header.blockCount) ? logIndex.block[indexNext + 1].offset : logIndex.header.logSize;
+    indexNext++;
+    blocksRead++;
+  }
+  else
+  {
+    logDebug("Read %" PRIu64 " of %" PRIu64 " index blocks\n", blocksRead, logIndex.header.blockCount);
+    logIndexFree(&logIndex);
+    indexed = false;
+  }
+
+  if (offset != position)
+  {
+    if (fseeko(file, (off_t) offset, SEEK_SET) != 0)
+    {
+      logAbort("Cannot seek in log file: %s\n", strerror(errno));
+    }
+    position = offset;
+  }
+}
+
+/*
+ * Read the next line of the log, like fgets().
+ */
+extern char *rangeReadLine(char *line, int size, FILE *file)
+{
+  if (indexed && position >= indexEnd)
+  {
+    seekNextBlock(file);
+  }
+  if (inputReadLine(line, size, file) == NULL)
+  {
+    return NULL;
+  }
+  position += strlen(line);
+  return line;
+}
+
+/*
+ * Return -1 when the message is before -from, 1 when it is after -to and 0 otherwise.
+ * Messages without a timestamp that can be parsed are in the range.
+ */
+extern int rangeCheck(const RawMessage *msg)
+{
+  uint64_t when;
+
+  if ((!haveFrom && !haveTo) || !parseTimestamp(msg->timestamp, &when))
+  {
+    return 0;
+  }
+  if (haveFrom && when < rangeFrom)
+  {
+    return -1;
+  }
+  if (haveTo && when > rangeTo)
+  {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,250 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Rate limiting.
+ *
+ * With -rate <n> at most <n> messages per second are passed for every combination of PGN
+ * and source. A -rate-table file can override the rate per PGN with lines of the form
+ *
+ *   # pgn  rate
+ *   127250 1
+ *   129029 0.2
+ *   126996 0
+ *
+ * where a rate of 0 means that the PGN is not limited.
+ *
+ * The decision is made on the raw frames, before fast packet reassembly and decoding, so
+ * a dropped message costs a table lookup. For fast packets it is made on the first frame,
+ * and the remaining frames with the same sequence number are dropped as well.
+ *
+ * Each (PGN, source) is allowed one message per period of 1/rate seconds. The periods are
+ * scheduled back to back, and a message that arrives up to a tenth of a period early is
+ * still accepted, so jitter in the message timestamps does not halve the rate.
+ */
+
+#include "analyzer.h"
+
+#define RATE_HASH_INITIAL (256)
+
+typedef struct RateOverride
+{
+  uint32_t pgn;
+  uint64_t period; // Milliseconds, 0 = not limited
+} RateOverride;
+
+typedef struct RateState
+{
+  uint32_t key; // Top bit | PGN << 8 | src, 0 = slot not used
+  uint64_t period;
+  uint64_t next;    // Time at which the next message is due, in milliseconds
+  int      dropSeq; // Sequence number of the fast packet being dropped, or -1
+} RateState;
+
+static uint64_t      ratePeriod; // Milliseconds, 0 = disabled
+static RateOverride *rateOverrides;
+static size_t        rateOverrideCount;
+static RateState    *rateStates;
+static size_t        rateStateMask;
+static size_t        rateStateUsed;
+static uint64_t      rateDropped;
+
+static uint64_t rateToPeriod(double rate)
+{
+  return (rate > 0.0) ? (uint64_t) (1000.0 / rate + 0.5) : 0;
+}
+
+extern void rateLimitInit(double rate)
+{
+  if (rate <= 0.0)
+  {
+    logAbort("Invalid rate %g\n", rate);
+  }
+  ratePeriod = rateToPeriod(rate);
+  if (ratePeriod == 0)
+  {
+    ratePeriod = 1;
+  }
+  logDebug("Rate limit: one message per %" PRIu64 " ms per PGN and source\n", ratePeriod);
+}
+
+extern void rateLimitLoad(const char *filename)
+{
+  FILE *file;
+  char  line[256];
+  int   lineNumber = 0;
+
+  file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    logAbort("Cannot open rate table file '%s'\n", filename);
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    unsigned int prn;
+    double       rate;
+    char         c;
+    int          n;
+
+    lineNumber++;
+    if (sscanf(line, " %c", &c) != 1 || c == '#')
+    {
+      continue;
+    }
+    n = sscanf(line, "%u %lf", &prn, &rate);
+    if (n != 2 || rate < 0.0)
+    {
+      logAbort("%s:%d: expected '<pgn> <rate>'\n", filename, lineNumber);
+    }
+    rateOverrides = realloc(rateOverrides, (rateOverrideCount + 1) * sizeof(RateOverride));
+    if (rateOverrides == NULL)
+    {
+      die("Out of memory");
+    }
+    rateOverrides[rateOverrideCount].pgn    = prn;
+    rateOverrides[rateOverrideCount].period = rateToPeriod(rate);
+    rateOverrideCount++;
+  }
+  fclose(file);
+}
+
+static uint64_t getPeriod(uint32_t pgn)
+{
+  for (size_t i = 0; i < rateOverrideCount; i++)
+  {
+    if (rateOverrides[i].pgn == pgn)
+    {
+      return rateOverrides[i].period;
+    }
+  }
+  return ratePeriod;
+}
+
+static RateState *findState(uint32_t key)
+{
+  size_t i = (key * 0x9e3779b1u) & rateStateMask;
+
+  while (rateStates[i].key != 0 && rateStates[i].key != key)
+  {
+    i = (i + 1) & rateStateMask;
+  }
+  return &rateStates[i];
+}
+
+static RateState *getState(uint32_t pgn, uint8_t src)
+{
+  uint32_t   key = (pgn << 8) | src | 0x80000000u; // Never 0, PGNs are at most 18 bits
+  RateState *state;
+
+  if (rateStates == NULL || rateStateUsed * 2 >= rateStateMask)
+  {
+    RateState *old     = rateStates;
+    size_t     oldSize = (old != NULL) ? rateStateMask + 1 : 0;
+    size_t     newSize = (old != NULL) ? oldSize * 2 : RATE_HASH_INITIAL;
+
+    rateStates = calloc(newSize, sizeof(RateState));
+    if (rateStates == NULL)
+    {
+      die("Out of memory");
+    }
+    rateStateMask = newSize - 1;
+    for (size_t i = 0; i < oldSize; i++)
+    {
+      if (old[i].key != 0)
+      {
+        *findState(old[i].key) = old[i];
+      }
+    }
+    free(old);
+  }
+
+  state = findState(key);
+  if (state->key == 0)
+  {
+    state->key     = key;
+    state->period  = getPeriod(pgn);
+    state->dropSeq = -1;
+    rateStateUsed++;
+  }
+  return state;
+}
+
+extern bool rateLimitEnabled(void)
+{
+  return ratePeriod != 0 || rateOverrideCount > 0;
+}
+
+/*
+ * Return true when this frame should be dropped because its (PGN, source) is over the rate.
+ */
+extern bool rateLimitDrop(const RawMessage *msg, bool fastPacket)
+{
+  RateState *state;
+  uint64_t   now;
+
+  if (ratePeriod == 0 && rateOverrideCount == 0)
+  {
+    return false;
+  }
+
+  state = getState(msg->pgn, msg->src);
+  if (state->period == 0)
+  {
+    return false;
+  }
+
+  if (fastPacket && msg->len > 0 && (msg->data[0] & 0x1f) != 0)
+  {
+    // Not the first frame, follow the decision made for the first frame
+    if (state->dropSeq == (msg->data[0] & 0xe0))
+    {
+      rateDropped++;
+      return true;
+    }
+    return false;
+  }
+
+  if (!parseTimestamp(msg->timestamp, &now))
+  {
+    return false;
+  }
+
+  if (state->next != 0 && now + state->period / 10 < state->next)
+  {
+    state->dropSeq = (fastPacket && msg->len > 0) ? (msg->data[0] & 0xe0) : -1;
+    rateDropped++;
+    return true;
+  }
+
+  state->next    = ((state->next > now) ? state->next : now) + state->period;
+  state->dropSeq = -1;
+  return false;
+}
+
+extern void rateLimitStatistics(void)
+{
+  if (rateDropped > 0)
+  {
+    logInfo("Rate limit: dropped %" PRIu64 " frames\n", rateDropped);
+  }
+}
@@ -0,0 +1,334 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Fast packet reassembly that tolerates frames that are out of order.
+ *
+ * Gateways that send frames over Wi-Fi or UDP, such as the YDWG, can deliver the frames of
+ * two fast packets from the same source and PGN interleaved. The normal reassembly keeps one
+ * buffer per source and PGN, so this ends in "incomplete fast packet" errors.
+ *
+ * With -reorder <window> every fast packet is reassembled in its own slot, keyed by input,
+ * source, PGN and the 3 bit sequence counter in the first byte of each frame. A fast packet
+ * that is complete is printed once the fast packets before it (by sequence counter) from the
+ * same source and PGN are printed. A fast packet that is not complete <window> (e.g. 20ms)
+ * after its first frame arrived, based on the message timestamps, is dropped so the ones
+ * after it are not held much longer than that. This is checked when a frame of any fast
+ * packet arrives.
+ *
+ * At the end the number of fast packets that were held, the time they were held and the most
+ * fast packets of one source and PGN that were in progress at the same time are logged.
+ */
+
+#include "analyzer.h"
+
+#define REORDER_SLOTS (64)
+#define REORDER_SEQ_AHEAD (3) // How many sequence numbers a fast packet can be after another one
+
+typedef struct ReorderSlot
+{
+  bool       used;
+  bool       complete;
+  size_t     input;
+  uint32_t   pgn;
+  uint8_t    src;
+  uint8_t    seq;
+  uint32_t   frames;    // Bit is one when frame is received
+  uint32_t   allFrames; // Bit is one when frame needs to be present, 0 until frame 0 arrived
+  size_t     size;
+  uint64_t   start; // Time of the first frame that arrived, in milliseconds
+  uint64_t   done;  // Time at which it was complete
+  RawMessage msg;   // Frame that completed it
+  uint8_t    data[FASTPACKET_MAX_SIZE];
+} ReorderSlot;
+
+static uint64_t       reorderWindow; // Milliseconds, 0 = disabled
+static ReorderPrinter printer;
+static ReorderSlot    slots[REORDER_SLOTS];
+static uint64_t       lastTime;
+static uint64_t       heldCount;
+static uint64_t       heldTotal; // Milliseconds
+static uint64_t       heldMax;
+static size_t         maxDepth;
+
+extern void reorderInit(const char *window)
+{
+  if (!parseDuration(window, &reorderWindow))
+  {
+    logAbort("Invalid reorder window '%s'\n", window);
+  }
+  logDebug("Reorder: holding fast packets for at most %" PRIu64 " ms\n", reorderWindow);
+}
+
+extern bool reorderEnabled(void)
+{
+  return reorderWindow != 0;
+}
+
+extern void reorderSetPrinter(ReorderPrinter p)
+{
+  printer = p;
+}
+
+static bool sameStream(const ReorderSlot *a, const ReorderSlot *b)
+{
+  return a->input == b->input && a->pgn == b->pgn && a->src == b->src;
+}
+
+/*
+ * Return true when fast packet a comes before fast packet b of the same stream.
+ */
+static bool before(const ReorderSlot *a, const ReorderSlot *b)
+{
+  unsigned int ahead = (b->seq - a->seq) & 7;
+
+  return ahead >= 1 && ahead <= REORDER_SEQ_AHEAD;
+}
+
+static void dropSlot(ReorderSlot *s)
+{
+  logError("Received incomplete fast packet PGN %u from source %u\n", s->pgn, s->src);
+  s->used = false;
+}
+
+static void printSlot(ReorderSlot *s)
+{
+  uint64_t held = lastTime - s->done;
+
+  if (held > 0)
+  {
+    heldCount++;
+    heldTotal += held;
+    heldMax = max(heldMax, held);
+  }
+  s->used = false;
+  printer(s->input, &s->msg, s->data, s->size);
+}
+
+/*
+ * Print the complete fast packets of the stream of <ref> that do not wait for another one.
+ */
+static void releaseStream(const ReorderSlot *ref)
+{
+  ReorderSlot key = *ref;
+  bool        printed;
+
+  do
+  {
+    ReorderSlot *first = NULL;
+
+    printed = false;
+    for (size_t i = 0; i < REORDER_SLOTS; i++)
+    {
+      ReorderSlot *s = &slots[i];
+
+      if (s->used && sameStream(s, &key) && (first == NULL || before(s, first)))
+      {
+        first = s;
+      }
+    }
+    if (first != NULL && first->complete)
+    {
+      printSlot(first);
+      printed = true;
+    }
+  } while (printed);
+}
+
+/*
+ * Drop the fast packets that are not complete within the window, and print the ones that
+ * waited for them.
+ */
+static void expireSlots(void)
+{
+  for (size_t i = 0; i < REORDER_SLOTS; i++)
+  {
+    ReorderSlot *s = &slots[i];
+
+    if (s->used && !s->complete && lastTime - s->start >= reorderWindow)
+    {
+      dropSlot(s);
+      releaseStream(s);
+    }
+  }
+}
+
+static ReorderSlot *findSlot(const RawMessage *msg, size_t input, uint8_t seq, size_t *depth)
+{
+  ReorderSlot *slot   = NULL;
+  ReorderSlot *oldest = NULL;
+
+  *depth = 0;
+  for (size_t i = 0; i < REORDER_SLOTS; i++)
+  {
+    ReorderSlot *s = &slots[i];
+
+    if (!s->used)
+    {
+      slot = (slot == NULL) ? s : slot;
+      continue;
+    }
+    if (s->input == input && s->pgn == msg->pgn && s->src == msg->src)
+    {
+      if (s->seq == seq)
+      {
+        return s;
+      }
+      (*depth)++;
+    }
+    if (!s->complete && (oldest == NULL || s->start < oldest->start))
+    {
+      oldest = s;
+    }
+  }
+
+  if (slot == NULL)
+  {
+    if (oldest == NULL)
+    {
+      return NULL;
+    }
+    dropSlot(oldest);
+    slot = oldest;
+  }
+  slot->used      = true;
+  slot->complete  = false;
+  slot->input     = input;
+  slot->pgn       = msg->pgn;
+  slot->src       = msg->src;
+  slot->seq       = seq;
+  slot->frames    = 0;
+  slot->allFrames = 0;
+  slot->start     = lastTime;
+  (*depth)++;
+  maxDepth = max(maxDepth, *depth);
+  return slot;
+}
+
+/*
+ * Add a frame of a fast packet of input <input>.
+ */
+extern void reorderFrame(const RawMessage *msg, size_t input)
+{
+  uint32_t     frame    = msg->data[0] & 0x1f;
+  uint8_t      seq      = msg->data[0] >> 5;
+  size_t       idx      = (frame == 0) ? 0 : FASTPACKET_BUCKET_0_SIZE + (frame - 1) * FASTPACKET_BUCKET_N_SIZE;
+  size_t       frameLen = (frame == 0) ? FASTPACKET_BUCKET_0_SIZE : FASTPACKET_BUCKET_N_SIZE;
+  size_t       msgIdx   = (frame == 0) ? FASTPACKET_BUCKET_0_OFFSET : FASTPACKET_BUCKET_N_OFFSET;
+  size_t       depth;
+  uint64_t     now;
+  ReorderSlot *s;
+
+  if (parseTimestamp(msg->timestamp, &now) && now > lastTime)
+  {
+    lastTime = now;
+    expireSlots();
+  }
+
+  s = findSlot(msg, input, seq, &depth);
+  if (s == NULL)
+  {
+    logError("Out of reassembly buffers; ignoring PGN %u\n", msg->pgn);
+    return;
+  }
+  if ((s->frames & (1 << frame)) != 0)
+  {
+    if (s->complete)
+    {
+      // The sequence counter wrapped while this one waited; do not wait for the others any longer
+      for (size_t i = 0; i < REORDER_SLOTS; i++)
+      {
+        if (slots[i].used && !slots[i].complete && sameStream(&slots[i], s) && before(&slots[i], s))
+        {
+          dropSlot(&slots[i]);
+        }
+      }
+      releaseStream(s);
+      s = findSlot(msg, input, seq, &depth);
+    }
+    else
+    {
+      dropSlot(s);
+      s = findSlot(msg, input, seq, &depth);
+    }
+  }
+
+  if (frame == 0)
+  {
+    s->size      = msg->data[1];
+    s->allFrames = (1 << (1 + (s->size / 7))) - 1;
+  }
+  memcpy(&s->data[idx], &msg->data[msgIdx], frameLen);
+  s->frames |= 1 << frame;
+
+  logDebug("Using reorder slot %zu for PGN %u: size %zu frame %u sequence %u frames=%x mask=%x depth=%zu\n",
+           (size_t) (s - slots),
+           msg->pgn,
+           s->size,
+           frame,
+           seq,
+           s->frames,
+           s->allFrames,
+           depth);
+  if (s->allFrames != 0 && (s->frames & s->allFrames) == s->allFrames)
+  {
+    s->complete = true;
+    s->done     = lastTime;
+    s->msg      = *msg;
+  }
+  releaseStream(s);
+}
+
+/*
+ * Print the fast packets that are still held, at the end of the input. Fast packets that are
+ * not complete are forgotten, like the normal reassembly does at the end.
+ */
+extern void reorderFlush(void)
+{
+  for (size_t i = 0; i < REORDER_SLOTS; i++)
+  {
+    if (slots[i].used && !slots[i].complete)
+    {
+      slots[i].used = false;
+    }
+  }
+  for (size_t i = 0; i < REORDER_SLOTS; i++)
+  {
+    if (slots[i].used)
+    {
+      releaseStream(&slots[i]);
+    }
+  }
+}
+
+extern void reorderStatistics(void)
+{
+  if (reorderWindow != 0)
+  {
+    logInfo("Reorder: held %" PRIu64 " fast packets for %.1f ms on average and at most %" PRIu64
+            " ms; at most %zu in progress per PGN and source\n",
+            heldCount,
+            (heldCount > 0) ? (double) heldTotal / (double) heldCount : 0.0,
+            heldMax,
+            maxDepth);
+  }
+}
@@ -0,0 +1,374 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Resampling.
+ *
+ * With -resample <interval> messages are not printed as they arrive. Instead they are
+ * collected per series, which is a combination of PGN, source and instance (when the PGN
+ * has an instance field), in buckets of <interval> based on the message timestamp.
+ * When a message arrives that falls in a later bucket, every series that received
+ * messages in the current bucket is printed once: the last message of the bucket,
+ * followed by an aggregate with the number of messages and the minimum, mean and
+ * maximum of each numeric field.
+ *
+ * Numeric fields are accumulated as raw integers, so the memory used per series does
+ * not depend on the number of messages. Fields that are not numeric, such as lookups
+ * and strings, are shown with their last value.
+ */
+
+#include "analyzer.h"
+
+typedef struct ResampleField
+{
+  const Field *field;
+  size_t       startBit;
+} ResampleField;
+
+typedef struct Accumulator
+{
+  uint32_t n;
+  int64_t  min;
+  int64_t  max;
+  double   sum;
+} Accumulator;
+
+typedef struct Series
+{
+  struct Series      *next;        // Next series of the same PGN
+  struct Series      *pendingNext; // Next series that has messages in the current bucket
+  struct ResamplePgn *rp;
+  uint8_t             src;
+  int64_t             instance;
+  uint32_t            count;
+  RawMessage          msg; // Header of the last message; the data is in <data>
+  uint8_t            *data;
+  size_t              length;
+  size_t              alloc;
+  Accumulator         acc[]; // One per ResamplePgn field
+} Series;
+
+typedef struct ResamplePgn
+{
+  const Field   *instanceField;
+  size_t         instanceStartBit;
+  size_t         fieldCount;
+  ResampleField *field;
+  Series        *series;
+} ResamplePgn;
+
+static uint64_t      resampleInterval; // Milliseconds, 0 = disabled
+static ResamplePgn **resamplePgns;     // Indexed by position in pgnList
+static uint64_t      currentBucket;
+static Series       *pendingHead;
+static Series      **pendingTail = &pendingHead;
+static const Series *flushing; // Series being printed by resampleFlush()
+
+extern void resampleInit(const char *interval)
+{
+  if (!parseDuration(interval, &resampleInterval))
+  {
+    logAbort("Invalid resample interval '%s'\n", interval);
+  }
+  resamplePgns = calloc(pgnListSize, sizeof(ResamplePgn *));
+  if (resamplePgns == NULL)
+  {
+    die("Out of memory");
+  }
+  logDebug("Resampling in buckets of %" PRIu64 " ms\n", resampleInterval);
+}
+
+static bool isAccumulatedField(const Field *field)
+{
+  return field->size > 0 && field->size <= 64 && (field->ft->pf == fieldPrintNumber || field->ft->pf == fieldPrintLatLon)
+         && strcmp(field->name, "SID") != 0;
+}
+
+/*
+ * Determine, once per PGN, which fields are accumulated and which field is the instance.
+ */
+static ResamplePgn *getResamplePgn(const Pgn *pgn)
+{
+  ResamplePgn *rp = resamplePgns[pgn - pgnList];
+  size_t       startBit;
+
+  if (rp != NULL)
+  {
+    return rp;
+  }
+
+  rp = calloc(1, sizeof(ResamplePgn));
+  if (rp == NULL || (rp->field = calloc(pgn->fieldCount, sizeof(ResampleField))) == NULL)
+  {
+    die("Out of memory");
+  }
+  for (size_t i = 0; i < pgn->fieldCount; i++)
+  {
+    const Field *field = &pgn->fieldList[i];
+
+    if (!getFixedStartBit(pgn, field, &startBit))
+    {
+      break;
+    }
+    if (rp->instanceField == NULL && isInstanceField(field))
+    {
+      rp->instanceField    = field;
+      rp->instanceStartBit = startBit;
+    }
+    else if (isAccumulatedField(field))
+    {
+      rp->field[rp->fieldCount].field    = field;
+      rp->field[rp->fieldCount].startBit = startBit;
+      rp->fieldCount++;
+    }
+  }
+  resamplePgns[pgn - pgnList] = rp;
+  return rp;
+}
+
+static Series *getSeries(ResamplePgn *rp, uint8_t src, int64_t instance)
+{
+  Series *s;
+
+  for (s = rp->series; s != NULL; s = s->next)
+  {
+    if (s->src == src && s->instance == instance)
+    {
+      return s;
+    }
+  }
+
+  s = calloc(1, sizeof(Series) + rp->fieldCount * sizeof(Accumulator));
+  if (s == NULL)
+  {
+    die("Out of memory");
+  }
+  s->rp       = rp;
+  s->src      = src;
+  s->instance = instance;
+  s->next     = rp->series;
+  rp->series  = s;
+  return s;
+}
+
+/*
+ * Collect a message. Returns true when the message is taken by the resampler and should
+ * not be printed now.
+ */
+extern bool resampleCollect(const Pgn *pgn, const RawMessage *msg, uint8_t *data, size_t length)
+{
+  ResamplePgn *rp;
+  Series      *s;
+  uint64_t     now;
+  uint64_t     bucket;
+  int64_t      instance = -1;
+  int64_t      value;
+  int64_t      maxValue;
+
+  if (resampleInterval == 0 || flushing != NULL)
+  {
+    return false;
+  }
+  if (!parseTimestamp(msg->timestamp, &now))
+  {
+    logDebug("Resample: cannot parse timestamp '%s', printing PGN %u as is\n", msg->timestamp, msg->pgn);
+    return false;
+  }
+
+  bucket = now / resampleInterval;
+  if (bucket != currentBucket)
+  {
+    resampleFlush();
+    currentBucket = bucket;
+  }
+
+  rp = getResamplePgn(pgn);
+  if (rp->instanceField != NULL)
+  {
+    extractNumber(rp->instanceField, data, length, rp->instanceStartBit, rp->instanceField->size, &instance, &maxValue);
+  }
+  s = getSeries(rp, msg->src, instance);
+
+  if (s->count == 0)
+  {
+    s->pendingNext = NULL;
+    *pendingTail   = s;
+    pendingTail    = &s->pendingNext;
+  }
+  s->count++;
+
+  if (s->alloc < length)
+  {
+    s->data = realloc(s->data, length);
+    if (s->data == NULL)
+    {
+      die("Out of memory");
+    }
+    s->alloc = length;
+  }
+  memcpy(s->data, data, length);
+  s->length = length;
+  memcpy(&s->msg, msg, offsetof(RawMessage, data));
+
+  for (size_t i = 0; i < rp->fieldCount; i++)
+  {
+    const Field *field = rp->field[i].field;
+    Accumulator *acc   = &s->acc[i];
+    int64_t      reserved;
+
+    if (!extractNumber(field, data, length, rp->field[i].startBit, field->size, &value, &maxValue))
+    {
+      continue;
+    }
+    reserved = (maxValue >= 7) ? 2 : (maxValue > 1) ? 1 : 0;
+    if (value > maxValue - reserved)
+    {
+      continue; // Not available or error
+    }
+    if (acc->n == 0 || value < acc->min)
+    {
+      acc->min = value;
+    }
+    if (acc->n == 0 || value > acc->max)
+    {
+      acc->max = value;
+    }
+    acc->sum += (double) value;
+    acc->n++;
+  }
+  return true;
+}
+
+static void printAggregateValue(const char *fieldName, const char *stat, const Field *field, double value, int extraPrecision)
+{
+  double      a         = value * field->resolution + field->unitOffset;
+  int         precision = field->precision;
+  const char *unit      = field->unit;
+
+  if (precision == 0)
+  {
+    for (double r = field->resolution; (r > 0.0) && (r < 1.0); r *= 10.0)
+    {
+      precision++;
+    }
+  }
+  precision += extraPrecision;
+
+  if (showJson)
+  {
+    mprintf("%s\"%s\":%.*f", (strcmp(stat, "min") == 0) ? "" : ",", stat, precision, a);
+  }
+  else
+  {
+    mprintf("; %s %s = %.*f", fieldName, stat, precision, a);
+    if (unit != NULL)
+    {
+      mprintf(" %s", unit);
+    }
+  }
+}
+
+/*
+ * Called by printPgn() when the message has been formatted: add the aggregate of the
+ * series that is being flushed.
+ */
+extern void resampleAppend(void)
+{
+  const ResamplePgn *rp;
+  size_t             end;
+
+  if (flushing == NULL)
+  {
+    return;
+  }
+  rp = flushing->rp;
+
+  // Remove the final "}\n" or "\n" so the aggregate is part of the same line
+  end = mlocation();
+  end -= (showJson && end >= 2 && mchr(end - 2) == '}') ? 2 : 1;
+  mset(end);
+
+  if (showJson)
+  {
+    mprintf(",\"aggregate\":{\"interval\":%.3f,\"count\":%u", resampleInterval / 1000.0, flushing->count);
+  }
+  else
+  {
+    mprintf("; Count = %u", flushing->count);
+  }
+
+  for (size_t i = 0; i < rp->fieldCount; i++)
+  {
+    const Field       *field     = rp->field[i].field;
+    const Accumulator *acc       = &flushing->acc[i];
+    const char        *fieldName = field->camelName ? field->camelName : field->name;
+
+    if (acc->n == 0)
+    {
+      continue;
+    }
+    if (showJson)
+    {
+      mprintf(",\"%s\":{", fieldName);
+    }
+    printAggregateValue(fieldName, "min", field, (double) acc->min, 0);
+    printAggregateValue(fieldName, "mean", field, acc->sum / acc->n, 1);
+    printAggregateValue(fieldName, "max", field, (double) acc->max, 0);
+    if (showJson)
+    {
+      mprintf("}");
+    }
+  }
+
+  mprintf(showJson ? "}}\n" : "\n");
+}
+
+/*
+ * Return true while resampleFlush() prints a series.
+ */
+extern bool resampleFlushing(void)
+{
+  return flushing != NULL;
+}
+
+/*
+ * Print all series that received messages in the current bucket, in the order in which
+ * they received their first message, and reset them.
+ */
+extern void resampleFlush(void)
+{
+  Series *s;
+  Series *next;
+
+  for (s = pendingHead; s != NULL; s = next)
+  {
+    next     = s->pendingNext;
+    flushing = s;
+    printPgn(&s->msg, s->data, s->length, false, showJson);
+    flushing = NULL;
+
+    s->count = 0;
+    memset(s->acc, 0, s->rp->fieldCount * sizeof(Accumulator));
+  }
+  pendingHead = NULL;
+  pendingTail = &pendingHead;
+}
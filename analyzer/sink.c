@@ -0,0 +1,440 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Output sinks.
+ *
+ * Every -output option adds a sink with its own output mode, optional PGN and source
+ * filter and destination:
+ *
+ *   -output <mode>[,pgn=<pgn>[+<pgn>...]][,src=<src>]:<destination>
+ *
+ * <mode> is one of text, json, json-empty, json-nv, json-nv-empty or raw. A raw sink
+ * receives a copy of the input lines. <destination> is a file name, '-' for stdout or
+ * fd:<n> for an already open file descriptor.
+ *
+ * The input is parsed and fast packets are reassembled once. Each message is then
+ * formatted once per sink that wants it, using the field printers of the sink's mode,
+ * and appended to the buffer of that sink; what is wrong with a message is only logged
+ * for the first sink. The sinks write without blocking when they can, so a slow reader
+ * only makes its own buffer grow; only when a buffer reaches SINK_BUFFER_MAX does the
+ * writer wait for that sink.
+ *
+ * Only the files that analyzer opens itself are made non blocking. Stdout and fd:<n> are
+ * shared with other code that expects them to block, so they are only written to when
+ * poll() says they are writable, and then at most PIPE_BUF bytes at a time.
+ */
+
+#include "analyzer.h"
+
+#include <limits.h>
+#include <poll.h>
+
+#define SINK_WRITE_SIZE (64 * 1024)        // Try to write once this much is buffered
+#define SINK_BUFFER_MAX (64 * 1024 * 1024) // Wait for the sink once this much is buffered
+
+typedef struct Sink
+{
+  const char *destination;
+  bool        raw;
+  OutputMode  mode;
+  uint32_t   *pgn;
+  size_t      pgnCount;
+  int         src; // -1 = all
+  int         fd;
+  bool        shared; // Stdout or fd:<n>, which stays blocking
+  char       *buf;
+  size_t      start; // Data in buf that is not written yet is buf[start .. end>
+  size_t      end;
+  size_t      alloc;
+} Sink;
+
+static Sink  *sinks;
+static size_t sinkCount;
+
+static const char *SINK_MODE_NAME[OUTPUT_MODE_COUNT] = {"text", "json", "json-empty", "json-nv", "json-nv-empty"};
+
+extern void sinkAdd(const char *spec)
+{
+  Sink       *s;
+  const char *colon = strchr(spec, ':');
+  const char *p;
+  size_t      len;
+  size_t      i;
+
+  if (colon == NULL || colon[1] == '\0')
+  {
+    logAbort("Invalid -output '%s'; expected '<mode>[,pgn=<pgn>[+<pgn>...]][,src=<src>]:<destination>'\n", spec);
+  }
+
+  sinks = realloc(sinks, (sinkCount + 1) * sizeof(Sink));
+  if (sinks == NULL)
+  {
+    die("Out of memory");
+  }
+  s = &sinks[sinkCount++];
+  memset(s, 0, sizeof(*s));
+  s->src         = -1;
+  s->fd          = -1;
+  s->destination = colon + 1;
+
+  len = strcspn(spec, ",:");
+  if (len == 3 && strncmp(spec, "raw", 3) == 0)
+  {
+    s->raw = true;
+  }
+  else
+  {
+    for (i = 0; i < OUTPUT_MODE_COUNT; i++)
+    {
+      if (strlen(SINK_MODE_NAME[i]) == len && strncmp(spec, SINK_MODE_NAME[i], len) == 0)
+      {
+        s->mode = (OutputMode) i;
+        break;
+      }
+    }
+    if (i == OUTPUT_MODE_COUNT)
+    {
+      logAbort("Invalid -output '%s'; unknown mode\n", spec);
+    }
+  }
+
+  for (p = spec + len; *p == ','; p += len)
+  {
+    p++;
+    len = strcspn(p, ",:");
+    if (strncmp(p, "pgn=", 4) == 0)
+    {
+      const char *q = p + 4;
+
+      while (q < p + len)
+      {
+        char *end;
+
+        s->pgn = realloc(s->pgn, (s->pgnCount + 1) * sizeof(uint32_t));
+        if (s->pgn == NULL)
+        {
+          die("Out of memory");
+        }
+        s->pgn[s->pgnCount++] = strtoul(q, &end, 10);
+        if (end == q || (*end != '+' && end != p + len))
+        {
+          logAbort("Invalid -output '%s'; expected pgn=<pgn>[+<pgn>...]\n", spec);
+        }
+        q = (*end == '+') ? end + 1 : end;
+      }
+    }
+    else if (strncmp(p, "src=", 4) == 0)
+    {
+      s->src = atoi(p + 4);
+    }
+    else
+    {
+      logAbort("Invalid -output '%s'; unknown option '%.*s'\n", spec, (int) len, p);
+    }
+  }
+
+  if (strncmp(s->destination, "fd:", 3) == 0)
+  {
+    char *end;
+    long  fd = strtol(s->destination + 3, &end, 10);
+
+    if (end == s->destination + 3 || *end != '\0' || fd < 0 || fd > INT_MAX)
+    {
+      logAbort("Invalid -output '%s'; expected fd:<n> with a file descriptor number\n", spec);
+    }
+  }
+}
+
+extern bool sinksEnabled(void)
+{
+  return sinkCount > 0;
+}
+
+/*
+ * Return the output mode of the first formatted sink, which is used for the parts
+ * that are prepared for a single output mode at startup.
+ */
+extern OutputMode sinkMainMode(OutputMode mode)
+{
+  for (size_t i = 0; i < sinkCount; i++)
+  {
+    if (!sinks[i].raw)
+    {
+      return sinks[i].mode;
+    }
+  }
+  return mode;
+}
+
+static bool sinkWritable(const Sink *s, bool wait)
+{
+  struct pollfd pfd;
+
+  pfd.fd     = s->fd;
+  pfd.events = POLLOUT;
+  return poll(&pfd, 1, wait ? -1 : 0) > 0;
+}
+
+static void sinkFlush(Sink *s, bool wait)
+{
+  while (s->start < s->end)
+  {
+    size_t  len = s->end - s->start;
+    ssize_t n;
+
+    if (s->shared && !wait)
+    {
+      // A blocking pipe that is writable takes PIPE_BUF bytes without waiting
+      if (!sinkWritable(s, false))
+      {
+        return;
+      }
+      len = CB_MIN(len, PIPE_BUF);
+    }
+    n = write(s->fd, s->buf + s->start, len);
+
+    if (n > 0)
+    {
+      s->start += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      if (!wait)
+      {
+        return;
+      }
+      sinkWritable(s, true);
+      continue;
+    }
+    logAbort("Cannot write to output '%s': %s\n", s->destination, strerror(errno));
+  }
+  s->start = 0;
+  s->end   = 0;
+}
+
+static void sinkAppend(Sink *s, const char *data, size_t len)
+{
+  if (s->end + len > s->alloc && s->start > 0)
+  {
+    memmove(s->buf, s->buf + s->start, s->end - s->start);
+    s->end -= s->start;
+    s->start = 0;
+  }
+  if (s->end + len > s->alloc)
+  {
+    if (s->end + len > SINK_BUFFER_MAX)
+    {
+      sinkFlush(s, true);
+    }
+    if (s->end + len > s->alloc)
+    {
+      size_t alloc = (s->alloc > 0) ? s->alloc : SINK_WRITE_SIZE * 2;
+
+      while (alloc < s->end + len)
+      {
+        alloc *= 2;
+      }
+      s->buf = realloc(s->buf, alloc);
+      if (s->buf == NULL)
+      {
+        die("Out of memory");
+      }
+      s->alloc = alloc;
+    }
+  }
+  memcpy(s->buf + s->end, data, len);
+  s->end += len;
+
+  if (s->end - s->start >= SINK_WRITE_SIZE)
+  {
+    sinkFlush(s, false);
+  }
+}
+
+extern void sinkOpen(void)
+{
+  for (size_t i = 0; i < sinkCount; i++)
+  {
+    Sink *s = &sinks[i];
+
+    if (strcmp(s->destination, "-") == 0)
+    {
+      s->fd     = STDOUT_FILENO;
+      s->shared = true;
+    }
+    else if (strncmp(s->destination, "fd:", 3) == 0)
+    {
+      s->fd     = (int) strtol(s->destination + 3, NULL, 10); // Checked by sinkAdd()
+      s->shared = true;
+    }
+    else
+    {
+      s->fd = open(s->destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (s->fd < 0)
+    {
+      logAbort("Cannot open output '%s': %s\n", s->destination, strerror(errno));
+    }
+#ifdef O_NONBLOCK
+    if (!s->shared)
+    {
+      fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+#endif
+
+    if (!s->raw && s->mode != OUTPUT_TEXT && showVersion)
+    {
+      char header[128];
+      int  len = snprintf(header,
+                         sizeof(header),
+                         "{\"version\":\"%s\",\"units\":\"%s\",\"showLookupValues\":%s}\n",
+                         VERSION,
+                         showSI ? "si" : "std",
+                         (s->mode == OUTPUT_JSON_NV || s->mode == OUTPUT_JSON_NV_EMPTY) ? "true" : "false");
+
+      sinkAppend(s, header, len);
+    }
+  }
+}
+
+extern void sinkClose(void)
+{
+  for (size_t i = 0; i < sinkCount; i++)
+  {
+    Sink *s = &sinks[i];
+
+    sinkFlush(s, true);
+    if (!s->shared)
+    {
+      close(s->fd);
+    }
+  }
+}
+
+static bool sinkWants(const Sink *s, const RawMessage *msg)
+{
+  if (s->src >= 0 && s->src != msg->src)
+  {
+    return false;
+  }
+  if (s->pgnCount == 0)
+  {
+    return true;
+  }
+  for (size_t i = 0; i < s->pgnCount; i++)
+  {
+    if (s->pgn[i] == msg->pgn)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Copy an input line to the raw sinks that want this message.
+ */
+extern void sinkRaw(const char *line, const RawMessage *msg)
+{
+  size_t len = strlen(line);
+
+  for (size_t i = 0; i < sinkCount; i++)
+  {
+    Sink *s = &sinks[i];
+
+    if (s->raw && sinkWants(s, msg))
+    {
+      sinkAppend(s, line, len);
+      if (len == 0 || line[len - 1] != '\n')
+      {
+        sinkAppend(s, "\n", 1);
+      }
+    }
+  }
+}
+
+static Sink *currentSink;
+
+/*
+ * Select the next formatted sink, starting at *index, that wants this message, and switch
+ * the output mode to that of the sink. Returns false when there are no more sinks, after
+ * restoring the original output mode.
+ */
+extern bool sinkSelect(size_t *index, const RawMessage *msg)
+{
+  static OutputMode savedMode;
+  static bool       savedJson;
+  static bool       savedJsonEmpty;
+  static bool       savedJsonValue;
+
+  if (currentSink == NULL)
+  {
+    savedMode      = outputMode;
+    savedJson      = showJson;
+    savedJsonEmpty = showJsonEmpty;
+    savedJsonValue = showJsonValue;
+  }
+
+  for (; *index < sinkCount; (*index)++)
+  {
+    Sink *s = &sinks[*index];
+
+    if (!s->raw && sinkWants(s, msg))
+    {
+      currentSink   = s;
+      outputMode    = s->mode;
+      showJson      = s->mode != OUTPUT_TEXT;
+      showJsonEmpty = s->mode == OUTPUT_JSON_EMPTY || s->mode == OUTPUT_JSON_NV_EMPTY;
+      showJsonValue = s->mode == OUTPUT_JSON_NV || s->mode == OUTPUT_JSON_NV_EMPTY;
+      (*index)++;
+      return true;
+    }
+  }
+
+  currentSink   = NULL;
+  outputMode    = savedMode;
+  showJson      = savedJson;
+  showJsonEmpty = savedJsonEmpty;
+  showJsonValue = savedJsonValue;
+  return false;
+}
+
+/*
+ * Write the formatted message to the selected sink, or to stdout when there is none.
+ */
+extern void sinkWrite(void)
+{
+  if (currentSink == NULL)
+  {
+    diskCacheCapture(mpointer(0), mlocation());
+    mwrite(stdout);
+    return;
+  }
+  sinkAppend(currentSink, mpointer(0), mlocation());
+  mreset();
+}
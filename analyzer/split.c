@@ -0,0 +1,417 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * Split output.
+ *
+ * With -split-dir <dir> every PGN is written to its own file <dir>/<pgn>.<ext> instead
+ * of stdout, or with -split-src to <dir>/<pgn>-<src>.<ext>. PGNs that have several
+ * definitions (proprietary PGNs) get the name of the definition appended, so every file
+ * holds records with the same fields.
+ *
+ * The records are in text (.txt) or JSON lines (.json) format as selected by -json, or
+ * with -split-csv in CSV format (.csv) with a header line with the field names. In CSV
+ * the values are as in JSON, without units; the values of a field in a repeating set
+ * are separated by '|'.
+ *
+ * Every open file has a SPLIT_BUFFER_SIZE stdio buffer. At most SPLIT_MAX_OPEN files are
+ * open at the same time; when another one is needed the least recently written one is
+ * closed and later reopened for appending.
+ */
+
+#include "analyzer.h"
+
+#define SPLIT_BUFFER_SIZE (256 * 1024)
+#define SPLIT_MAX_OPEN (64)
+#define SPLIT_HASH_INITIAL (256)
+
+typedef struct SplitFile
+{
+  uint32_t          key; // (Index in pgnList + 1) << 8 | src
+  const Pgn        *pgn;
+  uint8_t           src;
+  bool              created; // File has been created, reopen it for appending
+  FILE             *file;    // NULL when closed
+  char             *buffer;
+  struct SplitFile *newer; // List of open files, most recently written first
+  struct SplitFile *older;
+} SplitFile;
+
+typedef struct SplitColumn
+{
+  size_t index; // Field index in the PGN
+  size_t start; // Value in the message buffer
+  size_t end;
+} SplitColumn;
+
+static const char  *splitDir;
+static bool         splitSrc;
+static bool         splitCsv;
+static SplitFile  **splitFiles;
+static size_t       splitFileMask;
+static size_t       splitFileCount;
+static SplitFile   *newest;
+static SplitFile   *oldest;
+static size_t       openCount;
+static SplitColumn *columns;
+static size_t       columnCount;
+static size_t       columnAlloc;
+
+extern void splitSetDir(const char *dir)
+{
+  splitDir = dir;
+}
+
+extern void splitSetBySrc(void)
+{
+  splitSrc = true;
+}
+
+extern void splitSetCsv(void)
+{
+  splitCsv = true;
+}
+
+extern bool splitEnabled(void)
+{
+  return splitDir != NULL;
+}
+
+extern bool splitCsvEnabled(void)
+{
+  return splitDir != NULL && splitCsv;
+}
+
+extern void splitInit(void)
+{
+  if (splitDir == NULL)
+  {
+    if (splitSrc || splitCsv)
+    {
+      logAbort("-split-src and -split-csv need -split-dir\n");
+    }
+    return;
+  }
+  if (mkdir(splitDir, 0777) != 0 && errno != EEXIST)
+  {
+    logAbort("Cannot create directory '%s': %s\n", splitDir, strerror(errno));
+  }
+}
+
+extern void splitRecordStart(void)
+{
+  columnCount = 0;
+}
+
+/*
+ * Remember where the value of a field was printed, so the CSV row can be built from it.
+ */
+extern void splitColumn(size_t index, size_t start, size_t end)
+{
+  if (columnCount == columnAlloc)
+  {
+    columnAlloc = (columnAlloc > 0) ? columnAlloc * 2 : 64;
+    columns     = realloc(columns, columnAlloc * sizeof(SplitColumn));
+    if (columns == NULL)
+    {
+      die("Out of memory");
+    }
+  }
+  columns[columnCount].index = index;
+  columns[columnCount].start = start;
+  columns[columnCount].end   = end;
+  columnCount++;
+}
+
+static SplitFile **findFile(uint32_t key)
+{
+  size_t i = (key * 0x9e3779b1u) & splitFileMask;
+
+  while (splitFiles[i] != NULL && splitFiles[i]->key != key)
+  {
+    i = (i + 1) & splitFileMask;
+  }
+  return &splitFiles[i];
+}
+
+static SplitFile *getFile(const Pgn *pgn, uint8_t src)
+{
+  uint32_t    key = ((uint32_t) (pgn - pgnList + 1) << 8) | (splitSrc ? src : 0);
+  SplitFile **slot;
+
+  if (splitFiles == NULL || splitFileCount * 2 >= splitFileMask)
+  {
+    SplitFile **old     = splitFiles;
+    size_t      oldSize = (old != NULL) ? splitFileMask + 1 : 0;
+    size_t      newSize = (old != NULL) ? oldSize * 2 : SPLIT_HASH_INITIAL;
+
+    splitFiles = calloc(newSize, sizeof(SplitFile *));
+    if (splitFiles == NULL)
+    {
+      die("Out of memory");
+    }
+    splitFileMask = newSize - 1;
+    for (size_t i = 0; i < oldSize; i++)
+    {
+      if (old[i] != NULL)
+      {
+        *findFile(old[i]->key) = old[i];
+      }
+    }
+    free(old);
+  }
+
+  slot = findFile(key);
+  if (*slot == NULL)
+  {
+    *slot = calloc(1, sizeof(SplitFile));
+    if (*slot == NULL)
+    {
+      die("Out of memory");
+    }
+    (*slot)->key = key;
+    (*slot)->pgn = pgn;
+    (*slot)->src = src;
+    splitFileCount++;
+  }
+  return *slot;
+}
+
+static void unlinkFile(SplitFile *f)
+{
+  if (f->newer != NULL)
+  {
+    f->newer->older = f->older;
+  }
+  else
+  {
+    newest = f->older;
+  }
+  if (f->older != NULL)
+  {
+    f->older->newer = f->newer;
+  }
+  else
+  {
+    oldest = f->newer;
+  }
+  f->newer = NULL;
+  f->older = NULL;
+}
+
+static void closeFile(SplitFile *f)
+{
+  unlinkFile(f);
+  if (fclose(f->file) != 0)
+  {
+    logAbort("Cannot write to '%s': %s\n", splitDir, strerror(errno));
+  }
+  f->file = NULL;
+  free(f->buffer);
+  f->buffer = NULL;
+  openCount--;
+}
+
+static void printCsvHeader(SplitFile *f)
+{
+  fputs("timestamp,prio,src,dst,pgn", f->file);
+  for (size_t i = 0; i < f->pgn->fieldCount; i++)
+  {
+    const Field *field = &f->pgn->fieldList[i];
+
+    fprintf(f->file, ",%s", field->camelName ? field->camelName : field->name);
+  }
+  fputc('\n', f->file);
+}
+
+static void openFile(SplitFile *f)
+{
+  char  path[1024];
+  char *variant = NULL;
+  char  src[8]  = "";
+
+  if (openCount == SPLIT_MAX_OPEN)
+  {
+    closeFile(oldest);
+  }
+
+  if (f->pgn->hasMatchFields)
+  {
+    variant = camelize(f->pgn->description, true, 0);
+  }
+  if (splitSrc)
+  {
+    snprintf(src, sizeof(src), "-%u", f->src);
+  }
+  snprintf(path,
+           sizeof(path),
+           "%s/%u%s%s%s.%s",
+           splitDir,
+           f->pgn->pgn,
+           variant ? "-" : "",
+           variant ? variant : "",
+           src,
+           splitCsv ? "csv" : showJson ? "json" : "txt");
+  free(variant);
+
+  f->file = fopen(path, f->created ? "a" : "w");
+  if (f->file == NULL)
+  {
+    logAbort("Cannot open '%s': %s\n", path, strerror(errno));
+  }
+  f->buffer = malloc(SPLIT_BUFFER_SIZE);
+  if (f->buffer == NULL)
+  {
+    die("Out of memory");
+  }
+  setvbuf(f->file, f->buffer, _IOFBF, SPLIT_BUFFER_SIZE);
+  openCount++;
+
+  if (!f->created && splitCsv)
+  {
+    printCsvHeader(f);
+  }
+  f->created = true;
+}
+
+/*
+ * Print a JSON value as a CSV value: strings without their quotes and escapes, and
+ * quoted when they contain a comma, quote or line break.
+ */
+static void printCsvValue(FILE *file, const char *s, size_t len)
+{
+  bool quote = false;
+
+  if (len >= 2 && s[0] == '"' && s[len - 1] == '"')
+  {
+    s++;
+    len -= 2;
+  }
+  for (size_t i = 0; i < len; i++)
+  {
+    if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r' || s[i] == '\\')
+    {
+      quote = true;
+      break;
+    }
+  }
+  if (!quote)
+  {
+    fwrite(s, 1, len, file);
+    return;
+  }
+
+  fputc('"', file);
+  for (size_t i = 0; i < len; i++)
+  {
+    char c = s[i];
+
+    if (c == '\\' && i + 1 < len && strchr("\"\\/nrt", s[i + 1]) != NULL)
+    {
+      c = s[++i];
+      c = (c == 'n') ? '\n' : (c == 'r') ? '\r' : (c == 't') ? '\t' : c;
+    }
+    if (c == '"')
+    {
+      fputc('"', file);
+    }
+    fputc(c, file);
+  }
+  fputc('"', file);
+}
+
+static void printCsvRow(SplitFile *f, const RawMessage *msg)
+{
+  fprintf(f->file, "%s,%u,%u,%u,%u", msg->timestamp, msg->prio, msg->src, msg->dst, msg->pgn);
+  for (size_t i = 0; i < f->pgn->fieldCount; i++)
+  {
+    const char *sep = "";
+
+    fputc(',', f->file);
+    for (size_t j = 0; j < columnCount; j++)
+    {
+      if (columns[j].index == i)
+      {
+        fputs(sep, f->file);
+        printCsvValue(f->file, mpointer(columns[j].start), columns[j].end - columns[j].start);
+        sep = "|";
+      }
+    }
+  }
+  fputc('\n', f->file);
+}
+
+/*
+ * Write the formatted message to the file for its PGN. Returns false when the output is
+ * not split.
+ */
+extern bool splitWrite(const Pgn *pgn, const RawMessage *msg)
+{
+  SplitFile *f;
+
+  if (splitDir == NULL)
+  {
+    return false;
+  }
+
+  f = getFile(pgn, msg->src);
+  if (f->file == NULL)
+  {
+    openFile(f);
+  }
+  else if (f != newest)
+  {
+    unlinkFile(f);
+  }
+  if (f != newest)
+  {
+    f->older = newest;
+    if (newest != NULL)
+    {
+      newest->newer = f;
+    }
+    newest = f;
+    if (oldest == NULL)
+    {
+      oldest = f;
+    }
+  }
+
+  if (splitCsv)
+  {
+    printCsvRow(f, msg);
+  }
+  else
+  {
+    fwrite(mpointer(0), 1, mlocation(), f->file);
+  }
+  mreset();
+  return true;
+}
+
+extern void splitClose(void)
+{
+  while (oldest != NULL)
+  {
+    closeFile(oldest);
+  }
+}
@@ -0,0 +1,263 @@
+/*
+
+Analyzes NMEA 2000 PGNs.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+ * ISO 11783 (J1939) transport protocol reassembly.
+ *
+ * Messages of more than 8 bytes can also be sent with the transport protocol instead of as
+ * a fast packet: a connection management frame (PGN 60416) announces the PGN, its size (up
+ * to 1785 bytes) and the number of packets, and the data follows in data transfer frames
+ * (PGN 60160) of 7 bytes each, numbered from 1. A broadcast (BAM) is sent to address 255
+ * without handshake, a connection (RTS/CTS) to one address.
+ *
+ * With -iso-tp the data transfer frames are collected per sender and destination in one of
+ * TP_SESSIONS preallocated buffers. When all packets have arrived the message is decoded as
+ * the announced PGN, with the timestamp of the last packet. The connection management frames
+ * are still printed; the data transfer frames are not.
+ *
+ * A session is dropped when it is aborted, when it is announced again before it completed,
+ * or when no packet arrived for TP_TIMEOUT_MS milliseconds (the T1 timeout of the standard),
+ * based on the message timestamps.
+ */
+
+#include "analyzer.h"
+
+#define TP_SESSIONS (16)
+#define TP_MAX_SIZE (1785)
+#define TP_PACKET_SIZE (7)
+#define TP_TIMEOUT_MS (750)
+
+#define TP_CM_RTS (16)
+#define TP_CM_BAM (32)
+#define TP_CM_ABORT (255)
+
+typedef struct TpSession
+{
+  bool     used;
+  size_t   input;
+  uint8_t  src;
+  uint8_t  dst;
+  uint32_t pgn;
+  size_t   size;
+  uint8_t  packets;
+  uint8_t  received;
+  uint8_t  have[32]; // Bit per packet number that was received
+  uint64_t last;     // Time of the last frame, in milliseconds
+  uint8_t  data[TP_MAX_SIZE];
+} TpSession;
+
+static bool       tpEnabledFlag;
+static TpSession  sessions[TP_SESSIONS];
+static RawMessage tpMessage;
+static TpSession *tpDone;
+static uint64_t   tpCompleted;
+static uint64_t   tpDropped;
+
+extern void tpInit(void)
+{
+  tpEnabledFlag = true;
+}
+
+extern bool tpEnabled(void)
+{
+  return tpEnabledFlag;
+}
+
+static TpSession *findSession(size_t input, uint8_t src, uint8_t dst)
+{
+  for (size_t i = 0; i < TP_SESSIONS; i++)
+  {
+    TpSession *s = &sessions[i];
+
+    if (s->used && s->input == input && s->src == src && s->dst == dst)
+    {
+      return s;
+    }
+  }
+  return NULL;
+}
+
+static void dropSession(TpSession *s, const char *reason)
+{
+  logError("Dropped transport protocol PGN %u from source %u to %u: %s\n", s->pgn, s->src, s->dst, reason);
+  s->used = false;
+  tpDropped++;
+}
+
+static void expireSessions(uint64_t now)
+{
+  for (size_t i = 0; i < TP_SESSIONS; i++)
+  {
+    if (sessions[i].used && now > sessions[i].last + TP_TIMEOUT_MS)
+    {
+      dropSession(&sessions[i], "timeout");
+    }
+  }
+}
+
+static void startSession(const RawMessage *msg, size_t input, uint64_t now)
+{
+  TpSession *s    = findSession(input, msg->src, msg->dst);
+  size_t     size = msg->data[1] | (msg->data[2] << 8);
+
+  if (size <= 8 || size > TP_MAX_SIZE || msg->data[3] != (size + TP_PACKET_SIZE - 1) / TP_PACKET_SIZE)
+  {
+    logError("Invalid transport protocol announcement from source %u: %zu bytes in %u packets\n", msg->src, size, msg->data[3]);
+    return;
+  }
+  if (s != NULL)
+  {
+    dropSession(s, "announced again");
+  }
+  else
+  {
+    TpSession *oldest = NULL;
+
+    for (size_t i = 0; i < TP_SESSIONS && s == NULL; i++)
+    {
+      if (!sessions[i].used)
+      {
+        s = &sessions[i];
+      }
+      else if (oldest == NULL || sessions[i].last < oldest->last)
+      {
+        oldest = &sessions[i];
+      }
+    }
+    if (s == NULL)
+    {
+      dropSession(oldest, "out of transport protocol buffers");
+      s = oldest;
+    }
+  }
+
+  s->used     = true;
+  s->input    = input;
+  s->src      = msg->src;
+  s->dst      = msg->dst;
+  s->pgn      = msg->data[5] | (msg->data[6] << 8) | ((msg->data[7] & 0x03) << 16);
+  s->size     = size;
+  s->packets  = msg->data[3];
+  s->received = 0;
+  s->last     = now;
+  memset(s->have, 0, sizeof(s->have));
+}
+
+static RawMessage *addPacket(const RawMessage *msg, size_t input, uint64_t now)
+{
+  TpSession *s   = findSession(input, msg->src, msg->dst);
+  uint8_t    seq = msg->data[0];
+  size_t     offset;
+
+  if (s == NULL || seq == 0 || seq > s->packets || msg->len < 8)
+  {
+    logDebug("Ignoring transport protocol packet %u from source %u to %u\n", seq, msg->src, msg->dst);
+    return NULL;
+  }
+  s->last = now;
+  if ((s->have[seq / 8] & (1 << (seq % 8))) == 0)
+  {
+    s->have[seq / 8] |= 1 << (seq % 8);
+    s->received++;
+  }
+  offset = (size_t) (seq - 1) * TP_PACKET_SIZE;
+  memcpy(&s->data[offset], &msg->data[1], CB_MIN(TP_PACKET_SIZE, TP_MAX_SIZE - offset));
+
+  if (s->received < s->packets)
+  {
+    return NULL;
+  }
+
+  logDebug("Reassembled transport protocol PGN %u from source %u to %u: %zu bytes\n", s->pgn, s->src, s->dst, s->size);
+  tpMessage     = *msg;
+  tpMessage.pgn = s->pgn;
+  tpDone        = s;
+  s->used       = false;
+  tpCompleted++;
+  return &tpMessage;
+}
+
+/*
+ * Add a transport protocol frame of input <input>. When it completes a message, return the
+ * message header and set <data> and <len> to its data, which is valid until the next call.
+ */
+extern RawMessage *tpFrame(const RawMessage *msg, size_t input, uint8_t **data, size_t *len)
+{
+  uint64_t    now = 0;
+  RawMessage *done;
+
+  if ((msg->pgn != ISO_TP_CM_PGN && msg->pgn != ISO_TP_DT_PGN) || msg->len < 8)
+  {
+    return NULL;
+  }
+  if (parseTimestamp(msg->timestamp, &now))
+  {
+    expireSessions(now);
+  }
+
+  if (msg->pgn == ISO_TP_DT_PGN)
+  {
+    done = addPacket(msg, input, now);
+    if (done != NULL)
+    {
+      *data = tpDone->data;
+      *len  = tpDone->size;
+    }
+    return done;
+  }
+
+  switch (msg->data[0])
+  {
+    case TP_CM_RTS:
+    case TP_CM_BAM:
+      startSession(msg, input, now);
+      break;
+
+    case TP_CM_ABORT:
+    {
+      TpSession *s = findSession(input, msg->src, msg->dst);
+
+      if (s == NULL)
+      {
+        s = findSession(input, msg->dst, msg->src);
+      }
+      if (s != NULL)
+      {
+        dropSession(s, "aborted");
+      }
+      break;
+    }
+
+    default:
+      // Clear To Send and End Of Message Acknowledge do not change the data
+      break;
+  }
+  return NULL;
+}
+
+extern void tpStatistics(void)
+{
+  if (tpEnabledFlag)
+  {
+    logInfo("Transport protocol: %" PRIu64 " messages reassembled, %" PRIu64 " dropped\n", tpCompleted, tpDropped);
+  }
+}
@@ -32,6 +32,8 @@ limitations under the License.
 #include <time.h>
 
 #include "common.h"
+#include "logindex.h"
+#include "parse.h"
 
 #define MSG_BUF_SIZE 2000
 #define CANDUMP_DATA_INC_3 3
@@ -53,19 +55,76 @@ void gettimeval(struct timeval *tv, double sec)
   tv->tv_usec = (sec - tv->tv_sec) * 1000000;
 }
 
+// Get the time of a candump log line "(1502979132.106111) ..." in milliseconds, without floating point
+static bool candumpLineTime(const char *line, uint64_t *when)
+{
+  const char *p     = line;
+  uint64_t    msec  = 0;
+  uint64_t    scale = 100;
+
+  if (*p++ != '(' || *p < '0' || *p > '9')
+  {
+    return false;
+  }
+  for (; *p >= '0' && *p <= '9'; p++)
+  {
+    msec = msec * 10 + (*p - '0');
+  }
+  msec *= 1000;
+  if (*p == '.')
+  {
+    for (p++; *p >= '0' && *p <= '9'; p++, scale /= 10)
+    {
+      msec += (*p - '0') * scale;
+    }
+  }
+  if (*p != ')')
+  {
+    return false;
+  }
+  *when = msec;
+  return true;
+}
+
 int main(int argc, char **argv)
 {
-  char  msg[MSG_BUF_SIZE];
-  FILE *infile  = stdin;
-  FILE *outfile = stdout;
+  char     msg[MSG_BUF_SIZE];
+  FILE    *infile   = stdin;
+  FILE    *outfile  = stdout;
+  bool     haveFrom = false;
+  bool     haveTo   = false;
+  uint64_t from     = 0;
+  uint64_t to       = 0;
+  uint64_t when;
 
-  if (argc > 1)
+  for (; argc > 1 && argv[1][0] == '-'; argc--, argv++)
   {
     if (strcasecmp(argv[1], "-version") == 0)
     {
       printf("%s\n", VERSION);
       exit(0);
     }
+    else if (argc > 2 && strcasecmp(argv[1], "-from") == 0 && parseTimestamp(argv[2], &from))
+    {
+      haveFrom = true;
+      argc--;
+      argv++;
+    }
+    else if (argc > 2 && strcasecmp(argv[1], "-to") == 0 && parseTimestamp(argv[2], &to))
+    {
+      haveTo = true;
+      argc--;
+      argv++;
+    }
+    else
+    {
+      fprintf(stderr, "Usage: %s [-from <time>] [-to <time>] [<candump file>]\n", argv[0]);
+      fprintf(stderr, "       %s -version\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc > 1)
+  {
     infile = fopen(argv[1], "r");
     if (!infile)
     {
@@ -74,6 +133,12 @@ int main(int argc, char **argv)
     }
   }
 
+  // Candump log files (with timestamps) are in time order, so find the start by a binary search
+  if (haveFrom)
+  {
+    logSeekTime(infile, from, candumpLineTime);
+  }
+
   // For every line in the candump file...
   //
   int          format           = FMT_TBD;
@@ -138,6 +203,19 @@ int main(int argc, char **argv)
       size = size - 8;
     }
 
+    // -from and -to only apply to candump log files, the other formats have no absolute time
+    if (format == FMT_3 && (haveFrom || haveTo) && candumpLineTime(msg, &when))
+    {
+      if (haveFrom && when < from)
+      {
+        continue;
+      }
+      if (haveTo && when > to)
+      {
+        break;
+      }
+    }
+
     unsigned int pri = 0;
     unsigned int src = 0;
     unsigned int dst = 255;
@@ -25,10 +25,139 @@ StringBuffer sbNew;
 static const char *logLevels[] = {"FATAL", "ERROR", "INFO", "DEBUG"};
 
 static LogLevel logLevel = LOGLEVEL_INFO;
+static bool     logQuiet; // Only log FATAL messages
 
 static char *progName;
 static char  fixedTimestamp[DATE_LENGTH];
 
+/*
+ * Write `value` in decimal, padded with leading zeroes to at least `minDigits` digits.
+ * Returns the number of characters written; the result is not NUL terminated.
+ */
+size_t formatUnsigned(char *str, uint64_t value, int minDigits)
+{
+  char   tmp[20];
+  size_t n = 0;
+  size_t i;
+
+  do
+  {
+    tmp[n++] = '0' + (char) (value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (n < (size_t) minDigits && n < sizeof(tmp))
+  {
+    tmp[n++] = '0';
+  }
+  for (i = 0; i < n; i++)
+  {
+    str[i] = tmp[n - 1 - i];
+  }
+  return n;
+}
+
+/*
+ * Convert a number of days since 1970-01-01 to a proleptic Gregorian calendar date, using
+ * only integer arithmetic. See Howard Hinnant, "chrono-Compatible Low-Level Date Algorithms".
+ */
+void civilFromDays(int64_t days, int64_t *year, unsigned int *month, unsigned int *day)
+{
+  int64_t      era;
+  unsigned int doe; // Day of era
+  unsigned int yoe; // Year of era
+  unsigned int doy; // Day of year, starting at March 1st
+  unsigned int mp;  // Month, starting at March
+
+  days += 719468;
+  era = (days >= 0 ? days : days - 146096) / 146097;
+  doe = (unsigned int) (days - era * 146097);
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp  = (5 * doy + 2) / 153;
+
+  *day   = doy - (153 * mp + 2) / 5 + 1;
+  *month = mp < 10 ? mp + 3 : mp - 9;
+  *year  = (int64_t) yoe + era * 400 + (*month <= 2);
+}
+
+/*
+ * The inverse of civilFromDays(): the number of days since 1970-01-01 of a proleptic Gregorian date.
+ */
+int64_t daysFromCivil(int64_t year, unsigned int month, unsigned int day)
+{
+  int64_t      era;
+  unsigned int yoe; // Year of era
+  unsigned int doy; // Day of year, starting at March 1st
+  unsigned int doe; // Day of era
+
+  year -= (month <= 2);
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = (unsigned int) (year - era * 400);
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+/*
+ * Write the date `days` after 1970-01-01 as YYYY<separator>MM<separator>DD, NUL terminated.
+ * Returns the length of the string.
+ *
+ * Consecutive messages nearly always carry the same date, so the last date that was rendered
+ * is kept and reused when the day number is the same.
+ */
+size_t formatDate(char *str, uint64_t days, char separator)
+{
+  static uint64_t cachedDays = UINT64_MAX;
+  static char     cachedDate[32];
+  static size_t   cachedLen;
+  int64_t         year;
+  unsigned int    month;
+  unsigned int    day;
+  size_t          len;
+
+  if (days != cachedDays)
+  {
+    civilFromDays((int64_t) days, &year, &month, &day);
+    if (year < 0 || year > 9999)
+    {
+      cachedLen = (size_t) snprintf(cachedDate, sizeof(cachedDate), "%" PRId64 "-%02u-%02u", year, month, day);
+    }
+    else
+    {
+      len               = formatUnsigned(cachedDate, (uint64_t) year, 4);
+      cachedDate[len++] = '-';
+      len += formatUnsigned(cachedDate + len, month, 2);
+      cachedDate[len++] = '-';
+      len += formatUnsigned(cachedDate + len, day, 2);
+      cachedDate[len]   = '\0';
+      cachedLen         = len;
+    }
+    cachedDays = days;
+  }
+
+  memcpy(str, cachedDate, cachedLen + 1);
+  str[cachedLen - 6] = separator;
+  str[cachedLen - 3] = separator;
+  return cachedLen;
+}
+
+/*
+ * Write `seconds` as HH:MM:SS, NUL terminated. Hours are not wrapped at 24.
+ * Returns the length of the string.
+ */
+size_t formatTimeOfDay(char *str, uint64_t seconds)
+{
+  size_t len;
+
+  len        = formatUnsigned(str, seconds / 3600, 2);
+  str[len++] = ':';
+  len += formatUnsigned(str + len, seconds / 60 % 60, 2);
+  str[len++] = ':';
+  len += formatUnsigned(str + len, seconds % 60, 2);
+  str[len]   = '\0';
+  return len;
+}
+
 #ifndef WIN32
 
 uint64_t getNow(void)
@@ -52,17 +181,16 @@ uint64_t getNow(void)
 
 void storeTimestamp(char str[DATE_LENGTH], uint64_t when)
 {
-  time_t    t;
-  struct tm tm;
-  int       msec;
-  size_t    len;
-
-  t    = when / 1000L;
-  msec = when % 1000L;
-  gmtime_r(&t, &tm);
-  strftime(str, DATE_LENGTH - 5, "%Y-%m-%dT%H:%M:%S", &tm);
-  len = strlen(str);
-  snprintf(str + len, DATE_LENGTH - len, ".%3.3dZ", msec);
+  uint64_t t = when / 1000L;
+  size_t   len;
+
+  len        = formatDate(str, t / 86400, '-');
+  str[len++] = 'T';
+  len += formatTimeOfDay(str + len, t % 86400);
+  str[len++] = '.';
+  len += formatUnsigned(str + len, when % 1000L, 3);
+  str[len++] = 'Z';
+  str[len]   = '\0';
 }
 
 const char *now(char str[DATE_LENGTH])
@@ -106,7 +234,7 @@ static int logBase(LogLevel level, const char *format, va_list ap)
 {
   char strTmp[DATE_LENGTH];
 
-  if (level > logLevel)
+  if (level > logLevel || (logQuiet && level != LOGLEVEL_FATAL))
   {
     return 0;
   }
@@ -195,6 +323,11 @@ bool isLogLevelEnabled(LogLevel level)
   return logLevel >= level;
 }
 
+void setLogQuiet(bool quiet)
+{
+  logQuiet = quiet;
+}
+
 void setProgName(char *name)
 {
   progName = strrchr(name, '/');
@@ -711,6 +844,22 @@ unsigned int getCanIdFromISO11783Bits(unsigned int prio, unsigned int pgn, unsig
   return canId;
 }
 
+/*
+ * 64 bit FNV-1a hash. Pass HASH_INIT as `hash` for the first block, or the result of a previous
+ * call to continue hashing more data.
+ */
+uint64_t hashBytes(uint64_t hash, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *) data;
+
+  for (; len > 0; len--, p++)
+  {
+    hash ^= *p;
+    hash *= UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
 static void resolve_address(const char *url, char **host, const char **service)
 {
   const char *s;
@@ -113,6 +113,7 @@ void logAbort(const char *format, ...);
 void die(const char *t);
 void setLogLevel(LogLevel level);
 bool isLogLevelEnabled(LogLevel level);
+void setLogQuiet(bool quiet); // While set only FATAL messages are logged, whatever the log level
 void setProgName(char *name);
 void setFixedTimestamp(char *fixedStr);
 
@@ -178,6 +179,9 @@ bool         getJSONLookupName(const char *message, const char *fieldName, char
 void         getISO11783BitsFromCanId(unsigned int id, unsigned int *prio, unsigned int *pgn, unsigned int *src, unsigned int *dst);
 unsigned int getCanIdFromISO11783Bits(unsigned int prio, unsigned int pgn, unsigned int src, unsigned int dst);
 
+#define HASH_INIT UINT64_C(0xcbf29ce484222325)
+uint64_t hashBytes(uint64_t hash, const void *data, size_t len);
+
 SOCKET open_socket_stream(const char *url);
 
 #define DATE_LENGTH 60
@@ -185,6 +189,12 @@ const char *now(char str[DATE_LENGTH]);
 uint64_t    getNow(void);
 void        storeTimestamp(char str[DATE_LENGTH], uint64_t when);
 
+size_t  formatUnsigned(char *str, uint64_t value, int minDigits);
+void    civilFromDays(int64_t days, int64_t *year, unsigned int *month, unsigned int *day);
+int64_t daysFromCivil(int64_t year, unsigned int month, unsigned int day);
+size_t  formatDate(char *str, uint64_t days, char separator);
+size_t  formatTimeOfDay(char *str, uint64_t seconds);
+
 uint8_t scanNibble(char c);
 int     scanHex(char **p, uint8_t *m);
 
@@ -0,0 +1,289 @@
+/*
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <logindex.h>
+#include <parse.h>
+
+static unsigned int pgnBit(uint32_t pgn)
+{
+  return (pgn * 0x9e3779b1u) >> 23; // Top 9 bits, 0 .. LOG_INDEX_PGN_BITS - 1
+}
+
+void logIndexBlockInit(LogIndexBlock *block, uint64_t offset)
+{
+  memset(block, 0, sizeof(*block));
+  block->offset    = offset;
+  block->firstTime = UINT64_MAX;
+  block->lastTime  = 0;
+}
+
+/*
+ * Get the timestamp, PGN and source of a line in PLAIN or FAST format ("timestamp,prio,pgn,src,dst,len,...").
+ */
+bool logIndexParseLine(const char *line, uint64_t *when, uint32_t *pgn, uint8_t *src)
+{
+  char          timestamp[DATE_LENGTH];
+  const char   *comma = strchr(line, ',');
+  char         *end;
+  unsigned long prio;
+  unsigned long n;
+
+  if (comma == NULL || comma - line >= DATE_LENGTH)
+  {
+    return false;
+  }
+  memcpy(timestamp, line, comma - line);
+  timestamp[comma - line] = '\0';
+  prio                    = strtoul(comma + 1, &end, 10);
+  if (*end != ',' || prio > 7 || !parseTimestamp(timestamp, when))
+  {
+    return false;
+  }
+  *pgn = strtoul(end + 1, &end, 10);
+  if (*end != ',')
+  {
+    return false;
+  }
+  n = strtoul(end + 1, &end, 10);
+  if (*end != ',' || n > UINT8_MAX)
+  {
+    return false;
+  }
+  *src = (uint8_t) n;
+  return true;
+}
+
+/*
+ * Same as logIndexParseLine, for logSeekTime.
+ */
+bool logIndexLineTime(const char *line, uint64_t *when)
+{
+  uint32_t pgn;
+  uint8_t  src;
+
+  return logIndexParseLine(line, when, &pgn, &src);
+}
+
+/*
+ * Hash of the first line of a block, as read with fgets() in a buffer of LOG_LINE_MAX bytes.
+ */
+uint64_t logIndexLineHash(const char *line)
+{
+  return hashBytes(HASH_INIT, line, strlen(line));
+}
+
+void logIndexBlockAdd(LogIndexBlock *block, const char *line)
+{
+  uint64_t when;
+  uint32_t pgn;
+  uint8_t  src;
+
+  if (*line == '\0' || *line == '\r' || *line == '\n' || *line == '#')
+  {
+    return;
+  }
+
+  if (logIndexParseLine(line, &when, &pgn, &src))
+  {
+    unsigned int bit = pgnBit(pgn);
+
+    block->pgnMap[bit / 8] |= 1 << (bit % 8);
+    block->srcMap[src / 8] |= 1 << (src % 8);
+    block->firstTime = CB_MIN(block->firstTime, when);
+    block->lastTime  = CB_MAX(block->lastTime, when);
+    return;
+  }
+
+  // Not understood, so this block must always be read
+  memset(block->pgnMap, 0xff, sizeof(block->pgnMap));
+  memset(block->srcMap, 0xff, sizeof(block->srcMap));
+  block->firstTime = 0;
+  block->lastTime  = UINT64_MAX;
+}
+
+bool logIndexBlockHasPgn(const LogIndexBlock *block, uint32_t pgn)
+{
+  unsigned int bit = pgnBit(pgn);
+
+  return (block->pgnMap[bit / 8] & (1 << (bit % 8))) != 0;
+}
+
+bool logIndexBlockHasSrc(const LogIndexBlock *block, uint8_t src)
+{
+  return (block->srcMap[src / 8] & (1 << (src % 8))) != 0;
+}
+
+/*
+ * Is the first line of every block of the index still the same in log file `logName`?
+ */
+static bool blocksMatch(const char *logName, const LogIndex *index)
+{
+  char  line[LOG_LINE_MAX];
+  FILE *file = fopen(logName, "r");
+  bool  r    = (file != NULL);
+
+  for (uint64_t i = 0; r && i < index->header.blockCount; i++)
+  {
+    r = fseeko(file, (off_t) index->block[i].offset, SEEK_SET) == 0 && fgets(line, sizeof(line), file) != NULL
+        && logIndexLineHash(line) == index->block[i].lineHash;
+  }
+  if (file != NULL)
+  {
+    fclose(file);
+  }
+  return r;
+}
+
+/*
+ * Load the index of log file `logName`. Returns false when there is no usable index, and logs
+ * an error when there is an index that is invalid or that belongs to another version of the log.
+ */
+bool logIndexLoad(const char *logName, LogIndex *index)
+{
+  char        name[1024];
+  FILE       *file;
+  struct stat st;
+  bool        r = false;
+
+  memset(index, 0, sizeof(*index));
+  if (snprintf(name, sizeof(name), "%s" LOG_INDEX_SUFFIX, logName) >= (int) sizeof(name) || stat(logName, &st) != 0)
+  {
+    return false;
+  }
+  file = fopen(name, "rb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  if (fread(&index->header, sizeof(index->header), 1, file) == 1
+      && memcmp(index->header.magic, LOG_INDEX_MAGIC, LOG_INDEX_MAGIC_LEN) == 0 && index->header.endian == 0x01020304
+      && index->header.logSize <= (uint64_t) st.st_size && index->header.blockCount < SIZE_MAX / sizeof(LogIndexBlock))
+  {
+    index->block = malloc(index->header.blockCount * sizeof(LogIndexBlock) + 1);
+    if (index->block != NULL && fread(index->block, sizeof(LogIndexBlock), index->header.blockCount, file) == index->header.blockCount)
+    {
+      r = true;
+    }
+  }
+  fclose(file);
+
+  if (r && index->header.logInode != (uint64_t) st.st_ino)
+  {
+    r = false;
+  }
+  if (r && index->header.logMtime != (int64_t) st.st_mtime)
+  {
+    // Modified after indexing; still fine when it was only appended to
+    r = blocksMatch(logName, index);
+  }
+
+  if (!r)
+  {
+    logError("Ignoring index '%s' as it is invalid or does not match the log\n", name);
+    logIndexFree(index);
+  }
+  return r;
+}
+
+void logIndexFree(LogIndex *index)
+{
+  free(index->block);
+  memset(index, 0, sizeof(*index));
+}
+
+// Read up to and including the next newline
+static bool skipLine(FILE *file, char *line, size_t size)
+{
+  size_t len;
+
+  do
+  {
+    if (fgets(line, size, file) == NULL)
+    {
+      return false;
+    }
+    len = strlen(line);
+  } while (len > 0 && line[len - 1] != '\n');
+  return true;
+}
+
+/*
+ * Position `file` at the start of a line shortly before the first line with a timestamp of at
+ * least `from`, by a binary search on the byte offset. This assumes that the log is ordered by
+ * time. `lineTime` returns the timestamp of a line, or false for lines that do not have one.
+ *
+ * Returns false, without moving, when the file cannot be searched because it is not a regular
+ * file or has already been read from.
+ */
+bool logSeekTime(FILE *file, uint64_t from, bool (*lineTime)(const char *line, uint64_t *when))
+{
+  struct stat st;
+  char        line[LOG_LINE_MAX];
+  off_t       lo = 0;
+  off_t       hi;
+
+  if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || ftello(file) != 0)
+  {
+    return false;
+  }
+
+  for (hi = st.st_size; hi - lo > LOG_SEEK_LINEAR;)
+  {
+    off_t    mid       = lo + (hi - lo) / 2;
+    off_t    lineStart = 0;
+    uint64_t when;
+    bool     found = false;
+
+    // Skip the partial line at mid, then find the first line with a timestamp
+    if (fseeko(file, mid, SEEK_SET) != 0 || !skipLine(file, line, sizeof(line)))
+    {
+      break;
+    }
+    for (int n = 0; n < LOG_SEEK_TRIES && !found; n++)
+    {
+      lineStart = ftello(file);
+      if (lineStart >= hi || !skipLine(file, line, sizeof(line)))
+      {
+        break;
+      }
+      found = lineTime(line, &when);
+    }
+    if (!found)
+    {
+      break; // Cannot tell, read from lo
+    }
+    if (when < from)
+    {
+      lo = lineStart;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  if (fseeko(file, lo, SEEK_SET) != 0)
+  {
+    logAbort("Cannot seek in log file: %s\n", strerror(errno));
+  }
+  logDebug("Time search: start reading at offset %lld\n", (long long) lo);
+  return true;
+}
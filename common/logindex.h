@@ -0,0 +1,95 @@
+/*
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef LOGINDEX_H_INCLUDED
+#define LOGINDEX_H_INCLUDED
+
+#include <common.h>
+
+/*
+ * Sidecar index for raw log files, stored as <log>.idx.
+ *
+ * The log is divided in blocks of a fixed number of lines. For every block the index holds
+ * the byte offset of its first line, the lowest and highest timestamp in it and which PGNs
+ * and sources occur in it, so that a reader can seek to the blocks it needs.
+ *
+ * The PGN map is a 512 bit hash of the PGN, so it can say that a PGN is present when it is
+ * not, but never the other way around. Lines that cannot be parsed make the block match
+ * everything.
+ *
+ * The file is written in the native byte order; the magic detects an index from a machine
+ * with a different one. The index covers the first `logSize` bytes of the log, so a log that
+ * is appended to after indexing can still use it for the part that it covers.
+ *
+ * The index also holds the inode and modification time of the log and a hash of the first
+ * line of every block. An index of another file is not used. When the log was modified after
+ * indexing, the index is only used when the first line of every block is still the same.
+ *
+ * Logs without an index can still be searched for a start time with logSeekTime().
+ */
+
+#define LOG_INDEX_MAGIC "N2KIDX02"
+#define LOG_INDEX_MAGIC_LEN (8)
+#define LOG_INDEX_SUFFIX ".idx"
+#define LOG_INDEX_BLOCK_LINES (4096)
+#define LOG_INDEX_PGN_BITS (512)
+#define LOG_LINE_MAX (2000)
+#define LOG_SEEK_LINEAR (64 * 1024) // logSeekTime reads ranges smaller than this sequentially
+#define LOG_SEEK_TRIES (64)         // Lines to try to find a timestamp after a seek
+
+typedef struct
+{
+  char     magic[LOG_INDEX_MAGIC_LEN];
+  uint32_t endian; // 0x01020304 written natively
+  uint32_t blockLines;
+  uint64_t blockCount;
+  uint64_t logSize;
+  uint64_t logInode;
+  int64_t  logMtime; // Seconds
+} LogIndexHeader;
+
+typedef struct
+{
+  uint64_t offset;    // Offset of the first line of the block
+  uint64_t firstTime; // Lowest timestamp in the block, in milliseconds
+  uint64_t lastTime;  // Highest timestamp in the block, in milliseconds
+  uint64_t lineHash;  // hashBytes() of the first line of the block
+  uint8_t  pgnMap[LOG_INDEX_PGN_BITS / 8];
+  uint8_t  srcMap[256 / 8];
+} LogIndexBlock;
+
+typedef struct
+{
+  LogIndexHeader header;
+  LogIndexBlock *block;
+} LogIndex;
+
+bool     logIndexParseLine(const char *line, uint64_t *when, uint32_t *pgn, uint8_t *src);
+bool     logIndexLineTime(const char *line, uint64_t *when);
+uint64_t logIndexLineHash(const char *line);
+void     logIndexBlockInit(LogIndexBlock *block, uint64_t offset);
+void     logIndexBlockAdd(LogIndexBlock *block, const char *line);
+bool     logIndexBlockHasPgn(const LogIndexBlock *block, uint32_t pgn);
+bool     logIndexBlockHasSrc(const LogIndexBlock *block, uint8_t src);
+bool     logIndexLoad(const char *logName, LogIndex *index);
+void     logIndexFree(LogIndex *index);
+bool     logSeekTime(FILE *file, uint64_t from, bool (*lineTime)(const char *line, uint64_t *when));
+
+#endif
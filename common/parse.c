@@ -22,6 +22,115 @@ limitations under the License.
 
 #include <parse.h>
 
+// Parse exactly `digits` decimal digits
+static bool parseDigits(const char **p, int digits, unsigned int *value)
+{
+  *value = 0;
+  for (; digits > 0; digits--, (*p)++)
+  {
+    if (**p < '0' || **p > '9')
+    {
+      return false;
+    }
+    *value = *value * 10 + (**p - '0');
+  }
+  return true;
+}
+
+// Skip one character if it is one of `allowed`
+static bool parseChar(const char **p, const char *allowed)
+{
+  if (**p != '\0' && strchr(allowed, **p) != NULL)
+  {
+    (*p)++;
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Convert a message timestamp to milliseconds, without using the C library time functions.
+ * Understands the "YYYY-MM-DD[T-]HH:MM:SS[.,]fff[Z]" timestamps produced by the parsers above
+ * and by storeTimestamp(), and relative "seconds[.fff]" timestamps. Returns false for anything else.
+ *
+ * Timestamps without a time zone are treated as UTC; this is only meant for computing intervals.
+ */
+bool parseTimestamp(const char *str, uint64_t *when)
+{
+  const char  *p = str;
+  unsigned int year, month, day, hour, minute, second;
+  unsigned int digit;
+  uint64_t     msec = 0;
+  uint64_t     scale;
+
+  if (parseDigits(&p, 4, &year) && parseChar(&p, "-") && parseDigits(&p, 2, &month) && parseChar(&p, "-")
+      && parseDigits(&p, 2, &day) && parseChar(&p, "T- ") && parseDigits(&p, 2, &hour) && parseChar(&p, ":")
+      && parseDigits(&p, 2, &minute) && parseChar(&p, ":") && parseDigits(&p, 2, &second))
+  {
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+    {
+      return false;
+    }
+    msec = ((uint64_t) daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second) * 1000;
+  }
+  else
+  {
+    // Relative timestamp, seconds since some start
+    for (p = str; *p >= '0' && *p <= '9'; p++)
+    {
+      msec = msec * 10 + (*p - '0');
+    }
+    if (p == str)
+    {
+      return false;
+    }
+    msec *= 1000;
+  }
+
+  if (parseChar(&p, ".,"))
+  {
+    for (scale = 100; parseDigits(&p, 1, &digit); scale /= 10)
+    {
+      msec += digit * scale;
+    }
+  }
+  *when = msec;
+  return true;
+}
+
+/*
+ * Convert a duration such as "500ms", "1s", "10" (seconds), "1.5m" or "1h" to milliseconds.
+ * Returns false for anything else, or for a duration that is not positive.
+ */
+bool parseDuration(const char *str, uint64_t *duration)
+{
+  char  *end;
+  double d = strtod(str, &end);
+
+  if (end == str || d <= 0.0)
+  {
+    return false;
+  }
+  if (strcmp(end, "ms") == 0)
+  {
+    d /= 1000.0;
+  }
+  else if (strcmp(end, "m") == 0)
+  {
+    d *= 60.0;
+  }
+  else if (strcmp(end, "h") == 0)
+  {
+    d *= 3600.0;
+  }
+  else if (*end != '\0' && strcmp(end, "s") != 0)
+  {
+    return false;
+  }
+  *duration = (uint64_t) (d * 1000.0 + 0.5);
+  return *duration > 0;
+}
+
 static char *findOccurrence(char *msg, char c, int count)
 {
   int   i;
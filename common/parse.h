@@ -39,6 +39,8 @@ typedef struct
 bool parseFastFormat(StringBuffer *src, RawMessage *msg);
 bool parseInt(const char **msg, int *value, int defValue);
 bool parseConst(const char **msg, const char *str);
+bool parseTimestamp(const char *str, uint64_t *when);
+bool parseDuration(const char *str, uint64_t *duration);
 
 int parseRawFormatPlain(char *msg, RawMessage *m, bool showJson);
 int parseRawFormatFast(char *msg, RawMessage *m, bool showJson);
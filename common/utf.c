@@ -22,6 +22,11 @@ limitations under the License.
 #include "utf.h"
 
 #include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
 
 // The type of a single Unicode codepoint
 typedef uint32_t codepoint_t;
@@ -195,20 +200,86 @@ static size_t encode_utf8(codepoint_t codepoint, utf8_t *utf8, size_t len, size_
   return size;
 }
 
+// Copies the run of ASCII characters at the start of a UTF-16 string to a UTF-8 string.
+// As ASCII is encoded with a single byte in UTF-8 this is a plain narrowing copy,
+// which is done 8 (SSE2) or 4 (SWAR) characters at a time.
+//
+// utf16: The UTF-16 string
+// len: The maximum number of characters to copy
+// utf8: The UTF-8 string, or NULL if the run should only be measured
+//
+// return: The number of characters copied.
+static size_t narrow_ascii(utf16_t const *utf16, size_t len, utf8_t *utf8)
+{
+  size_t k = 0;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  const __m128i nonAscii = _mm_set1_epi16((short) ~UTF8_1_MAX);
+  const __m128i zero     = _mm_setzero_si128();
+
+  for (; k + 8 <= len; k += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) (utf16 + k));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), zero)) != 0xffff)
+      break;
+    if (utf8 != NULL)
+      _mm_storel_epi64((__m128i *) (utf8 + k), _mm_packus_epi16(v, v));
+  }
+#else
+  for (; k + 4 <= len; k += 4)
+  {
+    uint64_t v;
+
+    memcpy(&v, utf16 + k, sizeof(v));
+    if ((v & UINT64_C(0xFF80FF80FF80FF80)) != 0)
+      break;
+    if (utf8 != NULL)
+    {
+      for (size_t i = 0; i < 4; i++)
+        utf8[k + i] = (utf8_t) utf16[k + i];
+    }
+  }
+#endif
+
+  for (; k < len && utf16[k] <= UTF8_1_MAX; k++)
+  {
+    if (utf8 != NULL)
+      utf8[k] = (utf8_t) utf16[k];
+  }
+
+  return k;
+}
+
 size_t utf16_to_utf8(utf16_t const *utf16, size_t utf16_len, utf8_t *utf8, size_t utf8_len)
 {
   // The next codepoint that will be written in the UTF-8 string
   // or the size of the required buffer if utf8 is NULL
-  size_t utf8_index = 0;
+  size_t utf8_index  = 0;
+  size_t utf16_index = 0;
 
-  for (size_t utf16_index = 0; utf16_index < utf16_len; utf16_index++)
+  while (utf16_index < utf16_len)
   {
+    // Most strings are plain ASCII, so copy runs of those without decoding
+    size_t avail = utf16_len - utf16_index;
+
+    if (utf8 != NULL && utf8_len - utf8_index < avail)
+      avail = utf8_len - utf8_index;
+
+    size_t ascii = narrow_ascii(utf16 + utf16_index, avail, utf8 == NULL ? NULL : utf8 + utf8_index);
+
+    utf16_index += ascii;
+    utf8_index += ascii;
+    if (utf16_index >= utf16_len)
+      break;
+
     codepoint_t codepoint = decode_utf16(utf16, utf16_len, &utf16_index);
 
     if (utf8 == NULL)
       utf8_index += calculate_utf8_len(codepoint);
     else
       utf8_index += encode_utf8(codepoint, utf8, utf8_len, utf8_index);
+    utf16_index++;
   }
 
   return utf8_index;
@@ -0,0 +1,184 @@
+/*
+
+Writes a sidecar index for raw NMEA 2000 log files, so analyzer can seek to the
+part of the log that it needs for a time range, PGN or source.
+
+(C) 2009-2023, Kees Verruijt, Harlingen, The Netherlands.
+
+This file is part of CANboat.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "common.h"
+#include "logindex.h"
+
+#define MSG_BUF_SIZE LOG_LINE_MAX // logIndexLineHash() hashes what fgets() returns in a buffer this size
+
+static void usage(char **argv)
+{
+  fprintf(stderr, "Usage: %s [-lines <n>] [-d] [-q] <logfile> ...\n", argv[0]);
+  fprintf(stderr, "       %s -version\n", argv[0]);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Writes <logfile>" LOG_INDEX_SUFFIX " for every raw log file in PLAIN or FAST format.\n");
+  fprintf(stderr, "     -lines <n>        Index every <n> lines (default %d)\n", LOG_INDEX_BLOCK_LINES);
+  exit(1);
+}
+
+static void writeBlock(FILE *out, const char *name, const LogIndexBlock *block)
+{
+  if (fwrite(block, sizeof(*block), 1, out) != 1)
+  {
+    logAbort("Cannot write to '%s': %s\n", name, strerror(errno));
+  }
+}
+
+static void indexFile(const char *logName, uint32_t blockLines)
+{
+  char           msg[MSG_BUF_SIZE];
+  char           indexName[1024];
+  char           tmpName[1024 + 4];
+  FILE          *in;
+  FILE          *out;
+  struct stat    st;
+  LogIndexHeader header;
+  LogIndexBlock  block;
+  uint64_t       offset = 0;
+  uint32_t       lines  = 0;
+  bool           lineStart;
+
+  snprintf(indexName, sizeof(indexName), "%s" LOG_INDEX_SUFFIX, logName);
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", indexName);
+
+  in = fopen(logName, "r");
+  if (in == NULL || fstat(fileno(in), &st) != 0)
+  {
+    logAbort("Cannot open '%s': %s\n", logName, strerror(errno));
+  }
+  out = fopen(tmpName, "wb");
+  if (out == NULL)
+  {
+    logAbort("Cannot create '%s': %s\n", tmpName, strerror(errno));
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LOG_INDEX_MAGIC, LOG_INDEX_MAGIC_LEN);
+  header.endian     = 0x01020304;
+  header.blockLines = blockLines;
+  header.logInode   = (uint64_t) st.st_ino;
+  header.logMtime   = (int64_t) st.st_mtime;
+  if (fwrite(&header, sizeof(header), 1, out) != 1) // Rewritten when the block count is known
+  {
+    logAbort("Cannot write to '%s': %s\n", tmpName, strerror(errno));
+  }
+
+  logIndexBlockInit(&block, 0);
+  lineStart = true;
+  while (fgets(msg, sizeof(msg), in) != NULL)
+  {
+    size_t len = strlen(msg);
+
+    if (lineStart)
+    {
+      if (lines == blockLines)
+      {
+        writeBlock(out, tmpName, &block);
+        header.blockCount++;
+        logIndexBlockInit(&block, offset);
+        lines = 0;
+      }
+      if (lines == 0)
+      {
+        block.lineHash = logIndexLineHash(msg);
+      }
+      logIndexBlockAdd(&block, msg);
+      lines++;
+    }
+    offset += len;
+    lineStart = (len > 0 && msg[len - 1] == '\n');
+  }
+  if (ferror(in))
+  {
+    logAbort("Cannot read '%s': %s\n", logName, strerror(errno));
+  }
+  if (lines > 0)
+  {
+    writeBlock(out, tmpName, &block);
+    header.blockCount++;
+  }
+  fclose(in);
+
+  // The index only covers complete lines, a partial last line is read as if it was not indexed
+  if (!lineStart)
+  {
+    offset -= strlen(msg);
+  }
+  header.logSize = offset;
+
+  if (fseek(out, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, out) != 1 || fclose(out) != 0)
+  {
+    logAbort("Cannot write to '%s': %s\n", tmpName, strerror(errno));
+  }
+  if (rename(tmpName, indexName) != 0)
+  {
+    logAbort("Cannot rename '%s' to '%s': %s\n", tmpName, indexName, strerror(errno));
+  }
+  logInfo("Indexed %s: %" PRIu64 " blocks of %u lines\n", logName, header.blockCount, blockLines);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t blockLines = LOG_INDEX_BLOCK_LINES;
+  int      i;
+
+  setProgName(argv[0]);
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcasecmp(argv[i], "-version") == 0)
+    {
+      printf("%s\n", VERSION);
+      exit(0);
+    }
+    else if (strcasecmp(argv[i], "-lines") == 0 && i + 1 < argc)
+    {
+      blockLines = strtoul(argv[++i], 0, 10);
+      if (blockLines == 0)
+      {
+        usage(argv);
+      }
+    }
+    else if (strcasecmp(argv[i], "-d") == 0)
+    {
+      setLogLevel(LOGLEVEL_DEBUG);
+    }
+    else if (strcasecmp(argv[i], "-q") == 0)
+    {
+      setLogLevel(LOGLEVEL_ERROR);
+    }
+    else
+    {
+      usage(argv);
+    }
+  }
+  if (i == argc)
+  {
+    usage(argv);
+  }
+
+  for (; i < argc; i++)
+  {
+    indexFile(argv[i], blockLines);
+  }
+  return 0;
+}